@@ -0,0 +1,251 @@
+// Hardware abstraction for the WSPR beacon.
+//
+// main.cpp reaches the Si5351, WiFi, the web/DNS servers, NVS, the LED and
+// the clocks only through the functions below. hal_esp32.cpp binds them to
+// the Arduino-ESP32 libraries; native/hal_native.cpp backs them with a
+// virtual clock and recording fakes so the same beacon code builds and runs
+// on a Linux host ([env:native] in platformio.ini).
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+
+namespace hal {
+
+// ---------- CLOCK ----------
+int64_t monoUs();                     // monotonic microseconds since boot
+inline uint32_t monoMs() { return (uint32_t)(monoUs() / 1000); }
+void sleepMs(uint32_t ms);            // yields to other tasks
+void waitUntilUs(int64_t targetUs);   // tick sleep, then spin to the edge
+// waitUntilUs() stops tick-sleeping WAIT_SPIN_US before the target and spins
+// the rest, so a wake-up late by up to that less one tick costs nothing.
+static const int64_t WAIT_SPIN_US = 2500;
+time_t wallTime();                    // UTC seconds (0.. until NTP sync)
+int64_t wallUs();                     // UTC microseconds, same clock
+
+// One SNTP exchange in the background. done() fires on a network task after
+// the wall clock has been stepped by offsetUs, or on failure/timeout.
+struct NtpResult {
+  bool ok;
+  int64_t offsetUs;   // server - local, as applied
+  uint32_t rttUs;     // round trip minus server processing
+};
+typedef void (*NtpDone)(const NtpResult& result);
+bool ntpRequest(const char* server, NtpDone done);   // false: one in flight
+
+// ---------- SYSTEM ----------
+uint32_t hwRandom();
+void restart();
+// One-time allocation in external PSRAM; nullptr if the board has none.
+void* psramAlloc(size_t bytes);
+// Internal heap and PSRAM (zero without PSRAM), in bytes, with the block
+// counts of the internal heap for fragmentation.
+struct MemStats {
+  uint32_t heapFree;
+  uint32_t heapLargest;     // biggest block one malloc could get
+  uint32_t heapMinFree;     // low-water mark since boot
+  uint32_t heapFreeBlocks;
+  uint32_t heapUsedBlocks;
+  uint32_t psramFree;
+  uint32_t psramLargest;
+};
+MemStats memStats();
+// Heap allocations (malloc/calloc/realloc, so operator new and String too)
+// since boot, by calling task: the beacon is the task that called
+// workerStart(), the engine is the worker, everything else (web server,
+// WiFi, lwIP) is other. Flash I/O is exempt from the beacon's
+// zero-allocation budget: opening a LittleFS file or an NVS handle
+// allocates inside the filesystem on the calling task, so the periodic
+// history flush and settings saves (only on change) do allocate.
+struct AllocCounts {
+  uint32_t beacon;
+  uint32_t engine;
+  uint32_t other;
+};
+AllocCounts allocCounts();
+
+// ---------- POWER ----------
+// powerBegin() lets the CPU clock drop to minMhz whenever nothing holds it
+// and, with lightSleep, sleeps the chip while every task is blocked (timer
+// wakeups stay on time; the WiFi modem dozes between AP beacons). A build
+// without tickless idle refuses light sleep and keeps frequency scaling; one
+// without power management at all (the stock Arduino core) returns dfs false
+// and stays at full clock.
+struct PowerInfo {
+  bool dfs;
+  bool lightSleep;
+  uint16_t maxMhz;
+  uint16_t minMhz;
+};
+PowerInfo powerBegin(uint16_t maxMhz, uint16_t minMhz, bool lightSleep);
+void powerHold(bool on);       // full clock, no sleep while held (one owner)
+// Busy time since cpuMeterBegin(), averaged over the cores: sampled every
+// RTOS tick, slept time counts as idle. Independent of powerBegin(), so a
+// full-clock build measures too.
+void cpuMeterBegin();
+int64_t cpuActiveUs();
+
+// ---------- WORKER ----------
+// One high-priority job runner (the symbol engine). workerKick() runs fn
+// once on the worker; workerWait() returns true once that run finished.
+typedef void (*WorkerFn)();
+void workerStart(WorkerFn fn, const char* name, uint32_t stackBytes,
+                 uint8_t priority, int core);
+void workerKick();
+bool workerWait(uint32_t timeoutMs);
+
+// ---------- QUEUE / SHARED STATE ----------
+// The web and DNS servers run on their own task(s) on core 0. They hand work
+// to the beacon through fixed-size copy queues and read shared state under
+// stateLock(); nothing else crosses tasks.
+typedef void* Queue;
+Queue queueCreate(size_t itemSize, size_t depth);
+bool queueSend(Queue q, const void* item);        // never blocks; false if full
+// Sleeps until an item arrives or timeoutMs passes.
+bool queueReceive(Queue q, void* item, uint32_t timeoutMs);
+void stateLock();
+void stateUnlock();
+
+// ---------- RADIO (Si5351) ----------
+enum RadioClk : uint8_t { CLK0 = 0, CLK1 = 1, CLK2 = 2 };
+static const uint8_t RADIO_MS_REG[3] = { 42, 50, 58 };  // MSx parameter block
+static const uint8_t RADIO_MS_BYTES = 8;
+static const uint64_t RADIO_PLL_HZ = 800000000ULL;      // PLLA, fixed per frame
+
+void radioInit();                                  // all outputs muted
+void radioEnable(RadioClk clk, bool on);
+void radioStop(RadioClk clk);                      // park the output at 0 Hz
+// Lock PLLA at RADIO_PLL_HZ and load a full MSx register image.
+void radioLoadMs(RadioClk clk, const uint8_t img[RADIO_MS_BYTES]);
+// Burst write of consecutive registers; returns bytes on the bus, 0 if the
+// transfer failed (NAK, bus error).
+uint8_t radioWrite(uint8_t reg, const uint8_t* data, uint8_t n);
+
+// ---------- LED ----------
+// One RGB status pixel. ledStart() hands it to a low-priority task that
+// calls pattern(monoMs) every periodMs and latches the colour whenever it
+// changes; the beacon only updates state the pattern reads.
+struct Rgb { uint8_t r, g, b; };
+typedef Rgb (*LedPattern)(uint32_t nowMs);
+void ledInit();                                    // dark
+void ledStart(LedPattern pattern, uint32_t periodMs);
+
+// ---------- WIFI ----------
+// Station association returns at once; onLink() fires on a WiFi/event task
+// when the link gets an IP, or when it drops or an attempt fails. The
+// backend does not retry by itself. A known BSSID + channel skips the scan;
+// IPv4 addresses are a.b.c.d packed as (a << 24) | (b << 16) | (c << 8) | d.
+struct WifiStaConfig {
+  const char* ssid;
+  const char* pass;
+  const uint8_t* bssid;    // nullptr: any AP with this SSID
+  uint8_t channel;         // 0: scan all channels
+  uint32_t ip;             // 0: DHCP, the rest is ignored
+  uint32_t gateway;
+  uint32_t netmask;
+  uint32_t dns;
+};
+static const uint8_t WIFI_REASON_LEAVE = 8;   // we left (new attempt)
+struct WifiLink {
+  bool up;
+  uint8_t bssid[6];        // up: the AP we joined
+  uint8_t channel;
+  uint8_t reason;          // down: 802.11 / ESP-IDF disconnect reason
+};
+typedef void (*WifiLinkFn)(const WifiLink& link);
+void wifiStaConnect(const char* hostname, const WifiStaConfig& cfg, WifiLinkFn onLink);
+bool wifiStaConnected();
+// Dotted-quad IPs and scan SSIDs point at backend storage: valid until the
+// next call / wifiScanDelete(), never heap-allocated.
+const char* wifiStaIp();
+bool wifiStartAp(const char* ssid, const char* pass);
+const char* wifiApIp();
+// Starts a background scan; done(count) fires on a WiFi/event task when it
+// finishes (count < 0: failed). Results are readable from done() until
+// wifiScanDelete().
+typedef void (*WifiScanDone)(int count);
+bool wifiScanStart(WifiScanDone done);
+const char* wifiScanSsid(int i);
+int32_t wifiScanRssi(int i);
+void wifiScanDelete();
+
+void dnsStart();                      // captive: every name -> AP IP, own task
+bool mdnsBegin(const char* hostname);
+
+// ---------- HTTP ----------
+// Handlers run one at a time on the network task and act on the "current"
+// request; the server is event-driven, there is nothing to poll.
+typedef void (*HttpHandler)();
+enum class HttpMethod : uint8_t { Any, Get, Post, Put };
+// Largest non-form request body (JSON) kept for httpBody().
+static const size_t HTTP_BODY_MAX = 4096;
+
+void httpOn(const char* uri, HttpMethod method, HttpHandler handler);
+void httpOnNotFound(HttpHandler handler);
+void httpCollectHeaders(const char** names, size_t count);   // before httpBegin
+void httpBegin(uint16_t port);
+int64_t httpFirstResponseUs();   // monoUs() when the first request was answered, 0: none yet
+
+// Args and headers point into the request ("" if absent) and stay valid
+// until the handler returns; nothing is copied.
+bool httpHasArg(const char* name);
+const char* httpArg(const char* name);
+const char* httpHeader(const char* name);  // only collected headers
+// The raw body of a non-form request (e.g. application/json), NUL-terminated,
+// valid until the handler returns; nullptr if none arrived or it was over
+// HTTP_BODY_MAX. Form bodies are parsed into args instead.
+const char* httpBody();
+void httpSendHeader(const char* name, const char* value);
+void httpSend(int code, const char* type = nullptr, const char* body = nullptr);
+// Body sent in place from flash/static memory, no copy.
+void httpSendStatic(int code, const char* type, const uint8_t* data, size_t len);
+// Chunked response of unknown length: begin, any number of chunks, end.
+// The chunks are gathered into one of a few fixed response slots and sent
+// with Transfer-Encoding: chunked after httpEndChunked(). A body over
+// HTTP_CHUNKED_MAX answers 500 instead; with every slot in use, 503.
+static const size_t HTTP_CHUNKED_MAX = 40 * 1024;
+void httpBeginChunked(int code, const char* type);
+void httpSendChunk(const char* data, size_t len);
+void httpEndChunked();
+
+// Server-Sent Events: one push stream at `uri` (register before httpBegin).
+// eventsSend() copies the event into a fixed ring and returns; the network
+// task writes it to every connected client, so the caller never touches a
+// socket, allocates or blocks. With the ring full, or a client behind, the
+// event is lost and the page resyncs on reconnect. Data must be shorter
+// than EVENTS_DATA_MAX.
+static const size_t EVENTS_DATA_MAX = 256;
+void eventsBegin(const char* uri);
+uint8_t eventsClients();
+void eventsSend(const char* event, const char* data, uint32_t id);
+
+// ---------- FILES (LittleFS) ----------
+// Flat files on the data partition, opened per call. fsBegin() mounts it,
+// formatting a blank partition on first use.
+bool fsBegin();
+bool fsAppend(const char* path, const void* data, size_t len);
+size_t fsRead(const char* path, size_t offset, void* buf, size_t len);
+size_t fsSize(const char* path);          // 0 if absent
+bool fsRename(const char* from, const char* to);
+void fsRemove(const char* path);
+
+// ---------- KEY/VALUE STORAGE (NVS) ----------
+bool kvBegin(const char* ns, bool readOnly);
+void kvEnd();
+bool kvHas(const char* key);
+String kvGetString(const char* key, const char* def);
+void kvPutString(const char* key, const String& value);
+uint8_t kvGetU8(const char* key, uint8_t def);
+void kvPutU8(const char* key, uint8_t value);
+uint16_t kvGetU16(const char* key, uint16_t def);
+void kvPutU16(const char* key, uint16_t value);
+bool kvGetBool(const char* key, bool def);
+void kvPutBool(const char* key, bool value);
+double kvGetDouble(const char* key, double def);
+void kvPutDouble(const char* key, double value);
+// Raw blob: returns its stored size, or 0 if absent or larger than len.
+size_t kvGetBytes(const char* key, void* buf, size_t len);
+void kvPutBytes(const char* key, const void* data, size_t len);
+void kvRemove(const char* key);
+
+} // namespace hal
@@ -0,0 +1,1021 @@
+// ESP32 (Arduino) backend for hal.h.
+#ifdef ARDUINO
+
+#include "hal.h"
+
+#include <WiFi.h>
+#include <ESPAsyncWebServer.h>
+#include <ESPmDNS.h>
+#include <Preferences.h>
+#include <LittleFS.h>
+#include <Wire.h>
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+#include <sys/time.h>
+#include <esp_timer.h>
+#include <driver/rmt.h>
+#include <esp_pm.h>
+#include <esp_freertos_hooks.h>
+
+#include <si5351.h>
+
+// ---------- PINS / PERIPHERALS ----------
+#define LED_PIN 48
+#define I2C_SDA 8
+#define I2C_SCL 9
+
+static const uint32_t SI5351_CRYSTAL = 25000000UL;
+static const uint16_t DNS_PORT = 53;
+static const size_t DNS_MSG_MAX = 512;
+
+// Network services (DNS here, AsyncTCP via build flag) live on core 0, away
+// from the symbol engine on core 1.
+static const int NET_CORE = 0;
+static const UBaseType_t NET_TASK_PRIO = 3;
+
+static Si5351 si5351;
+static AsyncWebServer server(80);
+static Preferences prefs;
+
+static const si5351_clock SI_CLK[3] = { SI5351_CLK0, SI5351_CLK1, SI5351_CLK2 };
+
+namespace hal {
+
+// ---------- CLOCK ----------
+int64_t monoUs() {
+  return esp_timer_get_time();
+}
+
+void sleepMs(uint32_t ms) {
+  delay(ms);
+}
+
+void waitUntilUs(int64_t targetUs) {
+  for (;;) {
+    int64_t remain = targetUs - esp_timer_get_time();
+    if (remain <= 0) return;
+    if (remain > WAIT_SPIN_US) {
+      uint32_t ms = (uint32_t)((remain - WAIT_SPIN_US) / 1000);
+      vTaskDelay(ms ? pdMS_TO_TICKS(ms) : 1);
+    }
+  }
+}
+
+time_t wallTime() {
+  time_t now;
+  time(&now);
+  return now;
+}
+
+int64_t wallUs() {
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// SNTP client on its own core-0 task. lwIP's SNTP app only reports "synced",
+// so the exchange is done here to get the offset and round trip too.
+static const uint16_t NTP_PORT = 123;
+static const uint32_t NTP_TIMEOUT_MS = 3000;
+static const int64_t NTP_UNIX_EPOCH_S = 2208988800LL;   // 1900 -> 1970
+
+struct NtpJob { char server[64]; NtpDone done; };
+static QueueHandle_t ntpJobs = nullptr;
+
+static void ntpPut(uint8_t* p, int64_t unixUs) {
+  uint32_t sec = (uint32_t)(unixUs / 1000000 + NTP_UNIX_EPOCH_S);
+  uint32_t frac = (uint32_t)(((uint64_t)(unixUs % 1000000) << 32) / 1000000);
+  for (int i = 0; i < 4; i++) {
+    p[i] = (uint8_t)(sec >> (24 - 8 * i));
+    p[4 + i] = (uint8_t)(frac >> (24 - 8 * i));
+  }
+}
+
+static int64_t ntpGet(const uint8_t* p) {
+  uint32_t sec = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+  uint32_t frac = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+  return ((int64_t)sec - NTP_UNIX_EPOCH_S) * 1000000 + (int64_t)(((uint64_t)frac * 1000000) >> 32);
+}
+
+static bool ntpExchange(const char* server, NtpResult* r) {
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* res = nullptr;
+  if (getaddrinfo(server, "123", &hints, &res) != 0 || !res) return false;
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) { freeaddrinfo(res); return false; }
+  timeval to = { NTP_TIMEOUT_MS / 1000, (NTP_TIMEOUT_MS % 1000) * 1000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &to, sizeof(to));
+
+  uint8_t pkt[48] = {};
+  pkt[0] = 0x23;                       // LI 0, version 4, mode 3 (client)
+  int64_t t1 = wallUs();
+  int64_t m1 = esp_timer_get_time();
+  ntpPut(&pkt[40], t1);                // transmit timestamp, echoed back as originate
+  uint8_t sent[8];
+  memcpy(sent, &pkt[40], 8);
+
+  bool ok = sendto(fd, pkt, sizeof(pkt), 0, res->ai_addr, res->ai_addrlen) == (int)sizeof(pkt);
+  freeaddrinfo(res);
+  int n = ok ? recv(fd, pkt, sizeof(pkt), 0) : -1;
+  int64_t m4 = esp_timer_get_time();
+  close(fd);
+
+  if (n < 48 || (pkt[0] & 0x07) != 4 || pkt[1] == 0 || pkt[1] > 15) return false;
+  if (memcmp(&pkt[24], sent, 8) != 0) return false;   // not our request
+
+  int64_t t2 = ntpGet(&pkt[32]);
+  int64_t t3 = ntpGet(&pkt[40]);
+  int64_t t4 = t1 + (m4 - m1);         // monotonic, immune to steps meanwhile
+  r->offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+  int64_t rtt = (t4 - t1) - (t3 - t2);
+  r->rttUs = rtt > 0 ? (uint32_t)rtt : 0;
+
+  int64_t now = wallUs() + r->offsetUs;
+  timeval tv = { (time_t)(now / 1000000), (suseconds_t)(now % 1000000) };
+  settimeofday(&tv, nullptr);
+  return true;
+}
+
+static void ntpTask(void*) {
+  NtpJob job;
+  for (;;) {
+    xQueueReceive(ntpJobs, &job, portMAX_DELAY);
+    NtpResult r = {};
+    r.ok = ntpExchange(job.server, &r);
+    job.done(r);
+  }
+}
+
+bool ntpRequest(const char* server, NtpDone done) {
+  if (!ntpJobs) {
+    ntpJobs = xQueueCreate(1, sizeof(NtpJob));
+    xTaskCreatePinnedToCore(ntpTask, "ntp", 4096, nullptr, NET_TASK_PRIO, nullptr, NET_CORE);
+  }
+  NtpJob job;
+  strlcpy(job.server, server, sizeof(job.server));
+  job.done = done;
+  return xQueueSend(ntpJobs, &job, 0) == pdTRUE;
+}
+
+// ---------- SYSTEM ----------
+uint32_t hwRandom() {
+  return esp_random();
+}
+
+void restart() {
+  ESP.restart();
+}
+
+void* psramAlloc(size_t bytes) {
+  return psramFound() ? heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM) : nullptr;
+}
+
+MemStats memStats() {
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
+  MemStats m;
+  m.heapFree = info.total_free_bytes;
+  m.heapLargest = info.largest_free_block;
+  m.heapMinFree = info.minimum_free_bytes;
+  m.heapFreeBlocks = info.free_blocks;
+  m.heapUsedBlocks = info.allocated_blocks;
+  m.psramFree = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  m.psramLargest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+  return m;
+}
+
+// ---------- HEAP ACCOUNTING ----------
+// platformio.ini links with -Wl,--wrap for malloc, calloc and realloc, so
+// every allocation (operator new and String included) passes through here
+// and is counted against its task. Atomic adds: "other" has many writers.
+static TaskHandle_t beaconTask = nullptr;
+static TaskHandle_t workerTask = nullptr;
+static AllocCounts allocs = { 0, 0, 0 };
+
+static void countAlloc() {
+  TaskHandle_t t = xTaskGetCurrentTaskHandle();
+  uint32_t* n = t == beaconTask ? &allocs.beacon : t == workerTask ? &allocs.engine : &allocs.other;
+  __atomic_fetch_add(n, 1, __ATOMIC_RELAXED);
+}
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  countAlloc();
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  countAlloc();
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size) {
+  countAlloc();
+  return __real_realloc(p, size);
+}
+}
+
+AllocCounts allocCounts() {
+  AllocCounts c;
+  c.beacon = __atomic_load_n(&allocs.beacon, __ATOMIC_RELAXED);
+  c.engine = __atomic_load_n(&allocs.engine, __ATOMIC_RELAXED);
+  c.other = __atomic_load_n(&allocs.other, __ATOMIC_RELAXED);
+  return c;
+}
+
+// ---------- QUEUE / SHARED STATE ----------
+static SemaphoreHandle_t stateMutex = xSemaphoreCreateMutex();
+
+Queue queueCreate(size_t itemSize, size_t depth) {
+  return xQueueCreate(depth, itemSize);
+}
+
+bool queueSend(Queue q, const void* item) {
+  return xQueueSend((QueueHandle_t)q, item, 0) == pdTRUE;
+}
+
+bool queueReceive(Queue q, void* item, uint32_t timeoutMs) {
+  return xQueueReceive((QueueHandle_t)q, item, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+void stateLock() {
+  xSemaphoreTake(stateMutex, portMAX_DELAY);
+}
+
+void stateUnlock() {
+  xSemaphoreGive(stateMutex);
+}
+
+// ---------- POWER ----------
+static esp_pm_lock_handle_t pmFreqLock = nullptr;
+static esp_pm_lock_handle_t pmSleepLock = nullptr;
+static volatile uint32_t busyTicks = 0;   // both cores
+
+// Tick ISR on each core: a tick that lands outside the idle task is busy.
+static void countTick() {
+  BaseType_t core = xPortGetCoreID();
+  if (xTaskGetCurrentTaskHandleForCPU(core) != xTaskGetIdleTaskHandleForCPU(core)) busyTicks++;
+}
+
+void cpuMeterBegin() {
+  esp_register_freertos_tick_hook_for_cpu(countTick, 0);
+  esp_register_freertos_tick_hook_for_cpu(countTick, 1);
+}
+
+// The stock Arduino-ESP32 libraries are built without CONFIG_PM_ENABLE, and
+// then esp_pm_configure() answers ESP_ERR_NOT_SUPPORTED: say so, and run at
+// full clock. A core rebuilt with PM (and tickless idle for light sleep)
+// picks it up unchanged.
+PowerInfo powerBegin(uint16_t maxMhz, uint16_t minMhz, bool lightSleep) {
+  PowerInfo info = { false, false, maxMhz, minMhz };
+  WiFi.setSleep(true);   // modem sleep (WIFI_PS_MIN_MODEM), needed for light sleep
+
+  esp_pm_config_esp32s3_t cfg = { (int)maxMhz, (int)minMhz, lightSleep };
+  esp_err_t err = esp_pm_configure(&cfg);
+  if (err != ESP_OK && lightSleep) {
+    cfg.light_sleep_enable = false;
+    err = esp_pm_configure(&cfg);
+  }
+  if (err != ESP_OK) {
+    Serial.printf("Power: esp_pm_configure: %s, %s\n", esp_err_to_name(err),
+                  err == ESP_ERR_NOT_SUPPORTED ? "core built without CONFIG_PM_ENABLE" : "rejected");
+    return info;
+  }
+  esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "frame", &pmFreqLock);
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "frame", &pmSleepLock);
+  info.dfs = true;
+  info.lightSleep = cfg.light_sleep_enable;
+  return info;
+}
+
+void powerHold(bool on) {
+  if (!pmFreqLock) return;
+  if (on) {
+    esp_pm_lock_acquire(pmFreqLock);
+    esp_pm_lock_acquire(pmSleepLock);
+  } else {
+    esp_pm_lock_release(pmSleepLock);
+    esp_pm_lock_release(pmFreqLock);
+  }
+}
+
+int64_t cpuActiveUs() {
+  return (int64_t)busyTicks * portTICK_PERIOD_MS * 1000 / portNUM_PROCESSORS;
+}
+
+// ---------- WORKER ----------
+// workerTask and beaconTask live with the heap accounting above.
+static SemaphoreHandle_t workerDone = nullptr;
+static WorkerFn workerFn = nullptr;
+
+static void workerLoop(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    workerFn();
+    xSemaphoreGive(workerDone);
+  }
+}
+
+void workerStart(WorkerFn fn, const char* name, uint32_t stackBytes,
+                 uint8_t priority, int core) {
+  workerFn = fn;
+  beaconTask = xTaskGetCurrentTaskHandle();
+  workerDone = xSemaphoreCreateBinary();
+  xTaskCreatePinnedToCore(workerLoop, name, stackBytes, nullptr,
+                          priority, &workerTask, core);
+}
+
+void workerKick() {
+  xTaskNotifyGive(workerTask);
+}
+
+bool workerWait(uint32_t timeoutMs) {
+  return xSemaphoreTake(workerDone, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+// ---------- RADIO (Si5351) ----------
+void radioInit() {
+  Wire.begin(I2C_SDA, I2C_SCL);
+
+  // HARD mute outputs immediately
+  si5351.output_enable(SI5351_CLK0, 0);
+  si5351.output_enable(SI5351_CLK1, 0);
+  si5351.output_enable(SI5351_CLK2, 0);
+
+  // Now initialise the chip
+  si5351.init(SI5351_CRYSTAL_LOAD_8PF, SI5351_CRYSTAL, 0);
+
+  // Optional but recommended: reset PLLs
+  si5351.pll_reset(SI5351_PLLA);
+  si5351.pll_reset(SI5351_PLLB);
+
+  // Set drive strength while still muted; CLK1/CLK2 carry extra bands
+  for (si5351_clock clk : SI_CLK) {
+    si5351.drive_strength(clk, SI5351_DRIVE_8MA);
+    si5351.set_freq(0, clk);   // ensure frequency is zeroed
+  }
+}
+
+void radioEnable(RadioClk clk, bool on) {
+  si5351.output_enable(SI_CLK[clk], on ? 1 : 0);
+}
+
+void radioStop(RadioClk clk) {
+  si5351.set_freq(0, SI_CLK[clk]);
+}
+
+void radioLoadMs(RadioClk clk, const uint8_t img[RADIO_MS_BYTES]) {
+  Si5351RegSet r;
+  r.p3 = ((uint32_t)(img[5] & 0xF0) << 12) | ((uint32_t)img[0] << 8) | img[1];
+  r.p1 = ((uint32_t)(img[2] & 0x03) << 16) | ((uint32_t)img[3] << 8) | img[4];
+  r.p2 = ((uint32_t)(img[5] & 0x0F) << 16) | ((uint32_t)img[6] << 8) | img[7];
+
+  si5351.set_pll(RADIO_PLL_HZ * SI5351_FREQ_MULT, SI5351_PLLA);
+  si5351.set_ms_source(SI_CLK[clk], SI5351_PLLA);
+  si5351.set_ms(SI_CLK[clk], r, 0, SI5351_OUTPUT_CLK_DIV_1, 0);
+}
+
+uint8_t radioWrite(uint8_t reg, const uint8_t* data, uint8_t n) {
+  // Wire.endTransmission() status: 0 on ACK
+  return si5351.si5351_write_bulk(reg, n, (uint8_t*)data) == 0 ? n + 1 : 0;
+}
+
+// ---------- LED ----------
+// The pixel (GRBW, 800 kHz) is clocked out by the RMT peripheral: the 32
+// bits fit the channel's RAM, so a write returns as soon as they are copied
+// in and no interrupt is ever masked. Only the LED task writes.
+static const rmt_channel_t LED_RMT = RMT_CHANNEL_0;
+static const uint8_t LED_RMT_DIV = 2;                       // 40 MHz, 25 ns ticks
+static const rmt_item32_t LED_BIT0 = { { { 12, 1, 36, 0 } } };   // 0.3 us high, 0.9 us low
+static const rmt_item32_t LED_BIT1 = { { { 24, 1, 24, 0 } } };   // 0.6 us high, 0.6 us low
+static const UBaseType_t LED_TASK_PRIO = 1;
+static rmt_item32_t ledItems[32];
+static LedPattern ledPattern = nullptr;
+static uint32_t ledPeriodMs = 50;
+
+static void ledWrite(const Rgb& c) {
+  const uint8_t grbw[4] = { c.g, c.r, c.b, 0 };
+  for (uint8_t i = 0; i < 32; i++) {
+    ledItems[i] = (grbw[i / 8] & (0x80 >> (i % 8))) ? LED_BIT1 : LED_BIT0;
+  }
+  rmt_write_items(LED_RMT, ledItems, 32, false);
+}
+
+static void ledTask(void*) {
+  Rgb shown = { 0, 0, 0 };
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    Rgb c = ledPattern((uint32_t)(esp_timer_get_time() / 1000));
+    if (c.r != shown.r || c.g != shown.g || c.b != shown.b) {
+      ledWrite(c);
+      shown = c;
+    }
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(ledPeriodMs));
+  }
+}
+
+void ledInit() {
+  rmt_config_t cfg = RMT_DEFAULT_CONFIG_TX((gpio_num_t)LED_PIN, LED_RMT);
+  cfg.clk_div = LED_RMT_DIV;
+  rmt_config(&cfg);
+  rmt_driver_install(LED_RMT, 0, 0);
+  ledWrite({ 0, 0, 0 });
+}
+
+void ledStart(LedPattern pattern, uint32_t periodMs) {
+  ledPattern = pattern;
+  ledPeriodMs = periodMs;
+  xTaskCreatePinnedToCore(ledTask, "led", 2048, nullptr, LED_TASK_PRIO, nullptr, NET_CORE);
+}
+
+// ---------- WIFI ----------
+static WifiLinkFn linkFn = nullptr;
+
+static IPAddress toIp(uint32_t v) {
+  return IPAddress((uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v);
+}
+
+void wifiStaConnect(const char* hostname, const WifiStaConfig& cfg, WifiLinkFn onLink) {
+  static bool hooked = false;
+  if (!hooked) {
+    WiFi.onEvent([](arduino_event_id_t, arduino_event_info_t) {
+      WifiLink l = {};
+      l.up = true;
+      const uint8_t* bssid = WiFi.BSSID();
+      if (bssid) memcpy(l.bssid, bssid, sizeof(l.bssid));
+      l.channel = (uint8_t)WiFi.channel();
+      if (linkFn) linkFn(l);
+    }, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    WiFi.onEvent([](arduino_event_id_t, arduino_event_info_t info) {
+      WifiLink l = {};
+      l.reason = info.wifi_sta_disconnected.reason;
+      if (linkFn) linkFn(l);
+    }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    hooked = true;
+  }
+  linkFn = onLink;
+
+  WiFi.persistent(false);        // credentials live in our own blob
+  WiFi.setHostname(hostname);
+  WiFi.enableSTA(true);          // keeps the AP if it is up
+  WiFi.setAutoReconnect(false);  // retries and backoff are the caller's
+  if (cfg.ip) {
+    WiFi.config(toIp(cfg.ip), toIp(cfg.gateway), toIp(cfg.netmask), toIp(cfg.dns));
+  } else {
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());   // DHCP
+  }
+  WiFi.begin(cfg.ssid, cfg.pass, cfg.channel, cfg.bssid, true);
+}
+
+bool wifiStaConnected() {
+  return WiFi.status() == WL_CONNECTED;
+}
+
+static const char* formatIp(const IPAddress& ip) {
+  static char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return buf;
+}
+
+const char* wifiStaIp() {
+  return formatIp(WiFi.localIP());
+}
+
+bool wifiStartAp(const char* ssid, const char* pass) {
+  WiFi.mode(WIFI_AP_STA);
+  return WiFi.softAP(ssid, pass);
+}
+
+const char* wifiApIp() {
+  return formatIp(WiFi.softAPIP());
+}
+
+static WifiScanDone scanDone = nullptr;
+
+bool wifiScanStart(WifiScanDone done) {
+  static bool hooked = false;
+  if (!hooked) {
+    // WiFiScanClass has collected the records by the time user handlers run.
+    WiFi.onEvent([](arduino_event_id_t, arduino_event_info_t) {
+      if (scanDone) scanDone(WiFi.scanComplete());
+    }, ARDUINO_EVENT_WIFI_SCAN_DONE);
+    hooked = true;
+  }
+  scanDone = done;
+  return WiFi.scanNetworks(true, true) == WIFI_SCAN_RUNNING;
+}
+
+const char* wifiScanSsid(int i) {
+  // WiFi.SSID(i) would copy into a String; read the scan record in place.
+  const wifi_ap_record_t* rec = (const wifi_ap_record_t*)WiFi.getScanInfoByIndex(i);
+  return rec ? (const char*)rec->ssid : "";
+}
+
+int32_t wifiScanRssi(int i) {
+  return WiFi.RSSI(i);
+}
+
+void wifiScanDelete() {
+  WiFi.scanDelete();
+}
+
+// Captive DNS: a blocking UDP socket on its own task. Every A query is
+// answered with the AP address, which is all DNSServer did, minus polling.
+static uint32_t dnsApIp = 0;
+
+static void dnsTask(void*) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(DNS_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    Serial.println("DNS: bind failed");
+    if (fd >= 0) close(fd);
+    vTaskDelete(nullptr);
+    return;
+  }
+
+  static const uint8_t ANSWER[] = {
+    0xC0, 0x0C,             // name: pointer to the question
+    0x00, 0x01, 0x00, 0x01, // type A, class IN
+    0x00, 0x00, 0x00, 0x3C, // TTL 60 s
+    0x00, 0x04              // 4-byte address follows
+  };
+  uint8_t msg[DNS_MSG_MAX];
+
+  for (;;) {
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int n = recvfrom(fd, msg, sizeof(msg) - sizeof(ANSWER) - 4, 0, (sockaddr*)&from, &fromLen);
+    // Standard query (QR=0, opcode 0) with exactly one question.
+    if (n < 12 || (msg[2] & 0xF8) != 0 || msg[4] != 0 || msg[5] != 1) continue;
+
+    int p = 12;
+    while (p < n && msg[p]) p += msg[p] + 1;   // QNAME labels
+    p += 5;                                    // root label, QTYPE, QCLASS
+    if (p > n) continue;
+
+    msg[2] = 0x84 | (msg[2] & 0x01);   // response, authoritative, keep RD
+    msg[3] = 0x00;
+    msg[6] = 0; msg[7] = 1;            // ANCOUNT
+    memset(&msg[8], 0, 4);             // no NS / additional (drops EDNS)
+    memcpy(&msg[p], ANSWER, sizeof(ANSWER));
+    memcpy(&msg[p + sizeof(ANSWER)], &dnsApIp, 4);
+    sendto(fd, msg, p + sizeof(ANSWER) + 4, 0, (sockaddr*)&from, fromLen);
+  }
+}
+
+void dnsStart() {
+  dnsApIp = (uint32_t)WiFi.softAPIP();
+  xTaskCreatePinnedToCore(dnsTask, "dns", 3072, nullptr, NET_TASK_PRIO, nullptr, NET_CORE);
+}
+
+bool mdnsBegin(const char* hostname) {
+  if (!MDNS.begin(hostname)) return false;
+  MDNS.addService("http", "tcp", 80);
+  return true;
+}
+
+// ---------- HTTP ----------
+// AsyncTCP calls the handlers on its task (core 0, CONFIG_ASYNC_TCP_RUNNING_CORE).
+// Headers set before a send are buffered here and attached to the response.
+static AsyncWebServerRequest* req = nullptr;
+
+static const uint8_t HTTP_MAX_HEADERS = 4;
+struct PendingHeader { const char* name; char value[64]; };
+static PendingHeader pending[HTTP_MAX_HEADERS];
+static uint8_t pendingCount = 0;
+
+static int64_t firstResponseUs = 0;
+
+// Non-form bodies are gathered into one static buffer. A request owns it
+// from its first chunk until its handler has run (or it disconnects); a
+// second body arriving meanwhile is dropped and its handler sees none.
+static char body[HTTP_BODY_MAX + 1];
+static size_t bodyLen = 0;
+static bool bodyOverflow = false;
+static AsyncWebServerRequest* bodyOwner = nullptr;
+
+// Chunked bodies. A handler can't wait on the socket, so what it writes is
+// gathered into a fixed slot that the library's chunked filler drains as
+// the socket accepts it. A request holds its slot until it disconnects.
+static const uint8_t RESP_SLOTS = 4;
+struct RespSlot {
+  char* buf;                         // HTTP_CHUNKED_MAX bytes, from httpBegin()
+  size_t len;
+  AsyncWebServerRequest* owner;
+};
+static RespSlot slots[RESP_SLOTS];
+static RespSlot* building = nullptr;   // the slot of the handler running now
+static bool buildOverflow = false;
+static int buildCode = 0;
+static const char* buildType = nullptr;
+
+// A request has one disconnect callback (setting it again replaces it), so
+// both the body buffer and a response slot are released here.
+static void releaseOnDisconnect(AsyncWebServerRequest* r) {
+  r->onDisconnect([r]() {
+    if (bodyOwner == r) bodyOwner = nullptr;
+    for (RespSlot& s : slots) {
+      if (s.owner == r) s.owner = nullptr;
+    }
+  });
+}
+
+static void collectBody(AsyncWebServerRequest* r, uint8_t* data, size_t len,
+                        size_t index, size_t total) {
+  if (index == 0) {
+    if (bodyOwner && bodyOwner != r) return;
+    bodyOwner = r;
+    bodyLen = 0;
+    bodyOverflow = total > HTTP_BODY_MAX;
+    releaseOnDisconnect(r);
+  }
+  if (r != bodyOwner || bodyOverflow) return;
+  if (index + len > HTTP_BODY_MAX) {
+    bodyOverflow = true;
+    return;
+  }
+  memcpy(body + index, data, len);
+  bodyLen = index + len;
+}
+
+static void dispatch(AsyncWebServerRequest* r, HttpHandler handler) {
+  req = r;
+  pendingCount = 0;
+  handler();
+  req = nullptr;
+  if (bodyOwner == r) bodyOwner = nullptr;
+  if (!firstResponseUs) firstResponseUs = esp_timer_get_time();
+}
+
+static void sendResponse(AsyncWebServerResponse* r) {
+  for (uint8_t i = 0; i < pendingCount; i++) r->addHeader(pending[i].name, pending[i].value);
+  pendingCount = 0;
+  req->send(r);
+}
+
+static WebRequestMethodComposite toWebMethod(HttpMethod m) {
+  switch (m) {
+    case HttpMethod::Get:  return HTTP_GET;
+    case HttpMethod::Post: return HTTP_POST;
+    case HttpMethod::Put:  return HTTP_PUT;
+    default:               return HTTP_ANY;
+  }
+}
+
+void httpOn(const char* uri, HttpMethod method, HttpHandler handler) {
+  server.on(uri, toWebMethod(method),
+            [handler](AsyncWebServerRequest* r) { dispatch(r, handler); },
+            nullptr, collectBody);
+}
+
+void httpOnNotFound(HttpHandler handler) {
+  server.onNotFound([handler](AsyncWebServerRequest* r) { dispatch(r, handler); });
+}
+
+void httpCollectHeaders(const char**, size_t) {
+  // Callback handlers keep every request header.
+}
+
+void httpBegin(uint16_t port) {
+  (void)port;   // fixed at construction
+  for (RespSlot& s : slots) s.buf = (char*)psramAlloc(HTTP_CHUNKED_MAX);
+  if (!slots[0].buf) {   // no PSRAM: one slot from internal RAM
+    slots[0].buf = (char*)heap_caps_calloc(1, HTTP_CHUNKED_MAX, MALLOC_CAP_INTERNAL);
+  }
+  server.begin();
+}
+
+int64_t httpFirstResponseUs() {
+  return firstResponseUs;
+}
+
+// Looked up by hand: the library's by-name accessors build a String key.
+static AsyncWebParameter* findArg(const char* name) {
+  if (!req) return nullptr;
+  for (size_t i = 0; i < req->params(); i++) {
+    AsyncWebParameter* p = req->getParam(i);
+    if (strcmp(p->name().c_str(), name) == 0) return p;
+  }
+  return nullptr;
+}
+
+bool httpHasArg(const char* name) {
+  return findArg(name) != nullptr;
+}
+
+const char* httpArg(const char* name) {
+  AsyncWebParameter* p = findArg(name);
+  return p ? p->value().c_str() : "";
+}
+
+const char* httpHeader(const char* name) {
+  if (!req) return "";
+  for (size_t i = 0; i < req->headers(); i++) {
+    AsyncWebHeader* h = req->getHeader(i);
+    if (strcasecmp(h->name().c_str(), name) == 0) return h->value().c_str();
+  }
+  return "";
+}
+
+const char* httpBody() {
+  if (!req || req != bodyOwner || bodyOverflow) return nullptr;
+  body[bodyLen] = 0;
+  return body;
+}
+
+void httpSendHeader(const char* name, const char* value) {
+  if (pendingCount == HTTP_MAX_HEADERS) return;
+  pending[pendingCount].name = name;
+  strlcpy(pending[pendingCount].value, value, sizeof(pending[0].value));
+  pendingCount++;
+}
+
+void httpSend(int code, const char* type, const char* body) {
+  if (req) sendResponse(req->beginResponse(code, type ? type : "", body ? body : ""));
+}
+
+void httpSendStatic(int code, const char* type, const uint8_t* data, size_t len) {
+  if (req) sendResponse(req->beginResponse_P(code, type, data, len));
+}
+
+void httpBeginChunked(int code, const char* type) {
+  if (!req) return;
+  building = nullptr;
+  for (RespSlot& s : slots) {
+    if (s.buf && !s.owner) {
+      building = &s;
+      break;
+    }
+  }
+  if (!building) {
+    httpSendHeader("Retry-After", "1");
+    httpSend(503, "text/plain", "Busy, retry");
+    return;
+  }
+  building->owner = req;
+  building->len = 0;
+  buildOverflow = false;
+  buildCode = code;
+  buildType = type;
+  releaseOnDisconnect(req);
+}
+
+void httpSendChunk(const char* data, size_t len) {
+  if (!building || buildOverflow) return;
+  if (building->len + len > HTTP_CHUNKED_MAX) {
+    buildOverflow = true;
+    return;
+  }
+  memcpy(building->buf + building->len, data, len);
+  building->len += len;
+}
+
+void httpEndChunked() {
+  RespSlot* s = building;
+  building = nullptr;
+  if (!s || !req) return;
+  if (buildOverflow) {
+    s->owner = nullptr;
+    pendingCount = 0;
+    httpSend(500, "text/plain", "Response too large");
+    return;
+  }
+  AsyncWebServerResponse* r = req->beginChunkedResponse(buildType,
+      [s](uint8_t* out, size_t maxLen, size_t index) -> size_t {
+        size_t n = index < s->len ? min(maxLen, s->len - index) : 0;
+        memcpy(out, s->buf + index, n);
+        return n;
+      });
+  r->setCode(buildCode);
+  sendResponse(r);
+}
+
+// Push stream. The beacon only copies an event into a fixed ring; the
+// AsyncTCP task empties it from the streams' poll callbacks (every 500 ms)
+// and writes the text straight to each socket. The sockets are adopted
+// from the library once the response head is acked, so only the TCP task
+// ever touches them.
+static const uint8_t EVENTS_MAX_CLIENTS = 4;
+static const size_t EVENTS_RING = 16;
+static const uint32_t EVENTS_RETRY_MS = 2000;   // browser reconnect delay
+struct EventMsg {
+  uint32_t id;
+  char event[12];
+  char data[EVENTS_DATA_MAX];
+};
+static Queue eventRing = nullptr;
+static AsyncClient* eventClient[EVENTS_MAX_CLIENTS];
+static uint8_t eventClientCount = 0;            // written by the TCP task only
+static char eventText[EVENTS_DATA_MAX + 48];    // TCP task only
+
+static void eventsWrite(AsyncClient* c, const char* text, size_t len) {
+  if (c->space() >= len) c->write(text, len);   // else it falls behind: dropped
+}
+
+static void eventsDrain() {
+  static EventMsg m;
+  while (queueReceive(eventRing, &m, 0)) {
+    int n = snprintf(eventText, sizeof(eventText), "id: %u\nevent: %s\ndata: %s\n\n",
+                     (unsigned)m.id, m.event, m.data);
+    if (n <= 0 || (size_t)n >= sizeof(eventText)) continue;
+    for (AsyncClient* c : eventClient) {
+      if (c) eventsWrite(c, eventText, n);
+    }
+  }
+}
+
+static void eventsDrop(AsyncClient* c) {
+  for (AsyncClient*& e : eventClient) {
+    if (e == c) e = nullptr;
+  }
+  __atomic_store_n(&eventClientCount, (uint8_t)(eventClientCount - 1), __ATOMIC_RELAXED);
+  delete c;
+}
+
+// False if every stream is taken.
+static bool eventsAdopt(AsyncClient* c) {
+  AsyncClient** slot = nullptr;
+  for (AsyncClient*& e : eventClient) {
+    if (!e) slot = &e;
+  }
+  if (!slot) return false;
+  if (!eventClientCount) eventsDrain();   // nobody heard these; keep them off the new stream
+  *slot = c;
+  __atomic_store_n(&eventClientCount, (uint8_t)(eventClientCount + 1), __ATOMIC_RELAXED);
+  c->setRxTimeout(0);
+  c->onError(nullptr, nullptr);
+  c->onData(nullptr, nullptr);
+  c->onAck(nullptr, nullptr);
+  c->onPoll([](void*, AsyncClient*) { eventsDrain(); }, nullptr);
+  c->onTimeout([](void*, AsyncClient* c, uint32_t) { c->close(true); }, nullptr);
+  c->onDisconnect([](void*, AsyncClient* c) { eventsDrop(c); }, nullptr);
+  int n = snprintf(eventText, sizeof(eventText), "retry: %u\nevent: hello\ndata: {}\n\n",
+                   (unsigned)EVENTS_RETRY_MS);
+  eventsWrite(c, eventText, n);
+  return true;
+}
+
+// Sends the stream head, then hands the socket over on its ack, as the
+// library's own AsyncEventSourceResponse does.
+class EventStreamResponse : public AsyncWebServerResponse {
+public:
+  void _respond(AsyncWebServerRequest* r) override {
+    static const char HEAD[] =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+    r->client()->write(HEAD, sizeof(HEAD) - 1);
+    _state = RESPONSE_WAIT_ACK;
+  }
+  size_t _ack(AsyncWebServerRequest* r, size_t len, uint32_t) override {
+    if (!len) return 0;
+    AsyncClient* c = r->client();
+    if (!eventsAdopt(c)) {
+      c->close(true);   // the request is still attached and frees itself
+      return 0;
+    }
+    delete r;   // c's callbacks are ours now; nothing touches r or this after
+    return 0;
+  }
+  bool _sourceValid() const override { return true; }
+};
+
+void eventsBegin(const char* uri) {
+  eventRing = queueCreate(sizeof(EventMsg), EVENTS_RING);   // once, at setup
+  server.on(uri, HTTP_GET, [](AsyncWebServerRequest* r) {
+    r->send(new EventStreamResponse());
+  });
+}
+
+uint8_t eventsClients() {
+  return __atomic_load_n(&eventClientCount, __ATOMIC_RELAXED);
+}
+
+void eventsSend(const char* event, const char* data, uint32_t id) {
+  static EventMsg m;   // beacon task only
+  if (!eventRing || !eventsClients()) return;
+  m.id = id;
+  strlcpy(m.event, event, sizeof(m.event));
+  strlcpy(m.data, data, sizeof(m.data));
+  queueSend(eventRing, &m);   // full: this event is lost
+}
+
+// ---------- FILES (LittleFS) ----------
+// The "spiffs" data partition of the flash layout, mounted as LittleFS.
+bool fsBegin() {
+  return LittleFS.begin(true);
+}
+
+bool fsAppend(const char* path, const void* data, size_t len) {
+  File f = LittleFS.open(path, FILE_APPEND);
+  if (!f) return false;
+  size_t n = f.write((const uint8_t*)data, len);
+  f.close();
+  return n == len;
+}
+
+size_t fsRead(const char* path, size_t offset, void* buf, size_t len) {
+  if (!LittleFS.exists(path)) return 0;
+  File f = LittleFS.open(path, FILE_READ);
+  if (!f) return 0;
+  size_t n = f.seek(offset) ? f.read((uint8_t*)buf, len) : 0;
+  f.close();
+  return n;
+}
+
+size_t fsSize(const char* path) {
+  if (!LittleFS.exists(path)) return 0;
+  File f = LittleFS.open(path, FILE_READ);
+  if (!f) return 0;
+  size_t n = f.size();
+  f.close();
+  return n;
+}
+
+bool fsRename(const char* from, const char* to) {
+  return LittleFS.rename(from, to);
+}
+
+void fsRemove(const char* path) {
+  if (LittleFS.exists(path)) LittleFS.remove(path);
+}
+
+// ---------- KEY/VALUE STORAGE (NVS) ----------
+bool kvBegin(const char* ns, bool readOnly) {
+  return prefs.begin(ns, readOnly);
+}
+
+void kvEnd() {
+  prefs.end();
+}
+
+bool kvHas(const char* key) {
+  return prefs.isKey(key);
+}
+
+String kvGetString(const char* key, const char* def) {
+  return prefs.getString(key, def);
+}
+
+void kvPutString(const char* key, const String& value) {
+  prefs.putString(key, value);
+}
+
+uint8_t kvGetU8(const char* key, uint8_t def) {
+  return prefs.getUChar(key, def);
+}
+
+void kvPutU8(const char* key, uint8_t value) {
+  prefs.putUChar(key, value);
+}
+
+uint16_t kvGetU16(const char* key, uint16_t def) {
+  return prefs.getUShort(key, def);
+}
+
+void kvPutU16(const char* key, uint16_t value) {
+  prefs.putUShort(key, value);
+}
+
+bool kvGetBool(const char* key, bool def) {
+  return prefs.getBool(key, def);
+}
+
+void kvPutBool(const char* key, bool value) {
+  prefs.putBool(key, value);
+}
+
+double kvGetDouble(const char* key, double def) {
+  return prefs.getDouble(key, def);
+}
+
+void kvPutDouble(const char* key, double value) {
+  prefs.putDouble(key, value);
+}
+
+size_t kvGetBytes(const char* key, void* buf, size_t len) {
+  size_t n = prefs.getBytesLength(key);
+  if (!n || n > len) return 0;
+  return prefs.getBytes(key, buf, n);
+}
+
+void kvPutBytes(const char* key, const void* data, size_t len) {
+  prefs.putBytes(key, data, len);
+}
+
+void kvRemove(const char* key) {
+  prefs.remove(key);
+}
+
+} // namespace hal
+
+#endif // ARDUINO
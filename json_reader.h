@@ -0,0 +1,272 @@
+// Pull JSON reader over a caller-owned buffer; the request-side counterpart
+// of JsonWriter.
+//
+// The caller walks the document in the order it arrives and copies what it
+// wants into its own fixed fields; nothing is allocated and nothing is
+// built. The first error sticks: every later call fails, and ok()/errorAt()
+// report it (RFC 8259 syntax, or a value of the wrong type or size).
+//
+//   JsonReader r(body, strlen(body));
+//   char key[16];
+//   if (r.beginObject()) {
+//     while (r.nextKey(key, sizeof(key))) {
+//       if (!strcmp(key, "call")) r.string(call, sizeof(call));
+//       else r.skip();
+//     }
+//   }
+//   if (!r.ok()) ... r.errorAt() ...
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+class JsonReader {
+public:
+  JsonReader(const char* data, size_t len) : p_(data), begin_(data), end_(data + len) {}
+
+  bool ok() const { return ok_; }
+  size_t errorAt() const { return (size_t)(p_ - begin_); }
+
+  // True once the whole document has been read (only trailing blanks left).
+  bool done() {
+    ws();
+    return ok_ && p_ == end_;
+  }
+
+  bool beginObject() { return open('{'); }
+  bool beginArray()  { return open('['); }
+
+  // Next member of the innermost object into key; false at its closing '}'
+  // (consumed) or on error.
+  bool nextKey(char* key, size_t cap) {
+    if (!next('}')) return false;
+    if (!string(key, cap)) return false;
+    ws();
+    return expect(':');
+  }
+
+  // True if the innermost array has another element; false at its ']'.
+  bool nextItem() { return next(']'); }
+
+  // A string value into out (NUL-terminated, UTF-8); fails if it needs more
+  // than cap - 1 bytes.
+  bool string(char* out, size_t cap) {
+    ws();
+    if (!expect('"')) return false;
+    size_t n = 0;
+    while (ok_) {
+      if (p_ == end_) return fail();
+      char c = *p_++;
+      if (c == '"') break;
+      if ((unsigned char)c < 0x20) return fail();
+      if (c == '\\') {
+        if (p_ == end_) return fail();
+        c = *p_++;
+        switch (c) {
+          case '"': case '\\': case '/': break;
+          case 'b': c = '\b'; break;
+          case 'f': c = '\f'; break;
+          case 'n': c = '\n'; break;
+          case 'r': c = '\r'; break;
+          case 't': c = '\t'; break;
+          case 'u': {
+            uint32_t cp;
+            if (!hex4(&cp)) return false;
+            if (!utf8(cp, out, cap, &n)) return false;
+            continue;
+          }
+          default: return fail();
+        }
+      }
+      if (n + 1 >= cap) return fail();
+      out[n++] = c;
+    }
+    out[n] = 0;
+    return ok_;
+  }
+
+  bool number(double* v) {
+    ws();
+    const char* start = p_;
+    if (p_ < end_ && *p_ == '-') p_++;
+    if (!digits()) return fail();
+    if (p_ < end_ && *p_ == '.') { p_++; if (!digits()) return fail(); }
+    if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+      p_++;
+      if (p_ < end_ && (*p_ == '+' || *p_ == '-')) p_++;
+      if (!digits()) return fail();
+    }
+    char tmp[32];
+    size_t n = (size_t)(p_ - start);
+    if (n >= sizeof(tmp)) return fail();
+    memcpy(tmp, start, n);
+    tmp[n] = 0;
+    *v = strtod(tmp, nullptr);
+    return true;
+  }
+
+  // A number that must be a whole value in [lo, hi].
+  bool integer(long* v, long lo, long hi) {
+    double d;
+    if (!number(&d)) return false;
+    if (d < lo || d > hi || d != (double)(long)d) return fail();
+    *v = (long)d;
+    return true;
+  }
+
+  bool boolean(bool* v) {
+    ws();
+    if (literal("true")) { *v = true; return true; }
+    if (literal("false")) { *v = false; return true; }
+    return fail();
+  }
+
+  // Steps over one value of any type, containers included.
+  bool skip() {
+    ws();
+    if (p_ == end_) return fail();
+    char c = *p_;
+    if (c == '"') return skipString();
+    if (c == '{') {
+      if (!beginObject()) return false;
+      while (next('}')) {
+        if (!skipString()) return false;
+        ws();
+        if (!expect(':') || !skip()) return false;
+      }
+      return ok_;
+    }
+    if (c == '[') {
+      if (!beginArray()) return false;
+      while (nextItem()) if (!skip()) return false;
+      return ok_;
+    }
+    if (literal("true") || literal("false") || literal("null")) return true;
+    double d;
+    return number(&d);
+  }
+
+private:
+  static const uint8_t MAX_DEPTH = 8;
+
+  bool fail() {
+    ok_ = false;
+    return false;
+  }
+
+  void ws() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) p_++;
+  }
+
+  bool expect(char c) {
+    if (!ok_ || p_ == end_ || *p_ != c) return fail();
+    p_++;
+    return true;
+  }
+
+  bool open(char c) {
+    ws();
+    if (depth_ == MAX_DEPTH || !expect(c)) return fail();
+    first_[depth_++] = true;
+    return true;
+  }
+
+  // Shared by nextKey()/nextItem(): consumes the separator before the next
+  // element, or the closing bracket.
+  bool next(char close) {
+    if (!ok_ || !depth_) return fail();
+    ws();
+    if (p_ < end_ && *p_ == close) {
+      p_++;
+      depth_--;
+      return false;
+    }
+    if (!first_[depth_ - 1]) {
+      if (!expect(',')) return false;
+      ws();
+    }
+    first_[depth_ - 1] = false;
+    return p_ < end_ || fail();
+  }
+
+  // A string checked for syntax only, at any length.
+  bool skipString() {
+    ws();
+    if (!expect('"')) return false;
+    for (;;) {
+      if (p_ == end_) return fail();
+      char c = *p_++;
+      if (c == '"') return true;
+      if ((unsigned char)c < 0x20) return fail();
+      if (c != '\\') continue;
+      if (p_ == end_) return fail();
+      c = *p_++;
+      uint32_t cp;
+      if (c == 'u' && !hex4(&cp)) return false;
+      if (c != 'u' && (!c || !strchr("\"\\/bfnrt", c))) return fail();
+    }
+  }
+
+  bool digits() {
+    const char* start = p_;
+    while (p_ < end_ && *p_ >= '0' && *p_ <= '9') p_++;
+    return p_ > start;
+  }
+
+  bool literal(const char* word) {
+    size_t n = strlen(word);
+    if ((size_t)(end_ - p_) < n || memcmp(p_, word, n) != 0) return false;
+    p_ += n;
+    return true;
+  }
+
+  bool hex4(uint32_t* v) {
+    if (end_ - p_ < 4) return fail();
+    *v = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+      char c = *p_++;
+      uint32_t d = (c >= '0' && c <= '9') ? c - '0'
+                 : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : 16;
+      if (d > 15) return fail();
+      *v = (*v << 4) | d;
+    }
+    return true;
+  }
+
+  // \uXXXX (with its low surrogate if it is a high one) as UTF-8.
+  bool utf8(uint32_t cp, char* out, size_t cap, size_t* n) {
+    if (cp >= 0xDC00 && cp <= 0xDFFF) return fail();
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+      uint32_t lo;
+      if (end_ - p_ < 2 || p_[0] != '\\' || p_[1] != 'u') return fail();
+      p_ += 2;
+      if (!hex4(&lo)) return false;
+      if (lo < 0xDC00 || lo > 0xDFFF) return fail();
+      cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+    }
+    if (cp == 0) return fail();   // would cut the C string short
+    uint8_t len = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+    if (*n + len >= cap) return fail();
+    if (len == 1) {
+      out[(*n)++] = (char)cp;
+      return true;
+    }
+    static const uint8_t LEAD[5] = { 0, 0, 0xC0, 0xE0, 0xF0 };
+    for (uint8_t i = len; i-- > 0;) {
+      out[*n + i] = (char)(i ? 0x80 | (cp & 0x3F) : LEAD[len] | cp);
+      cp >>= 6;
+    }
+    *n += len;
+    return true;
+  }
+
+  const char* p_;
+  const char* begin_;
+  const char* end_;
+  bool ok_ = true;
+  uint8_t depth_ = 0;
+  bool first_[MAX_DEPTH];
+};
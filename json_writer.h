@@ -0,0 +1,167 @@
+// Streaming JSON writer over a caller-owned fixed buffer.
+//
+// Output is pushed to a sink whenever the buffer fills and on finish(), so a
+// response of any length costs one buffer and no heap. Keys and string values
+// are escaped per RFC 8259; numbers are formatted without printf/float code.
+//
+//   JsonWriter w(buf, sizeof(buf), hal::httpSendChunk);
+//   w.beginObject();
+//   w.field("call", CALLSIGN);
+//   w.field("pwr_dbm", 10);
+//   w.endObject();
+//   w.finish();
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class JsonWriter {
+public:
+  typedef void (*Sink)(const char* data, size_t len);
+
+  JsonWriter(char* buf, size_t cap, Sink sink) : buf_(buf), cap_(cap), sink_(sink) {}
+
+  void beginObject(const char* key = nullptr) { open(key, '{'); }
+  void endObject()                            { close('}'); }
+  void beginArray(const char* key = nullptr)  { open(key, '['); }
+  void endArray()                             { close(']'); }
+
+  // Array elements.
+  void value(const char* s)        { sep(); str(s); }
+  void value(long long v)          { sep(); num(v); }
+  void value(int v)                { value((long long)v); }
+  void value(long v)               { value((long long)v); }
+  void value(unsigned v)           { value((long long)v); }
+  void value(unsigned long v)      { value((long long)v); }
+  void value(bool b)               { sep(); raw(b ? "true" : "false"); }
+  void fixedValue(double v, uint8_t decimals) { sep(); fix(v, decimals); }
+
+  // Object members.
+  void field(const char* k, const char* s)     { name(k); str(s); }
+  void field(const char* k, long long v)       { name(k); num(v); }
+  void field(const char* k, int v)             { field(k, (long long)v); }
+  void field(const char* k, long v)            { field(k, (long long)v); }
+  void field(const char* k, unsigned v)        { field(k, (long long)v); }
+  void field(const char* k, unsigned long v)   { field(k, (long long)v); }
+  void field(const char* k, bool b)            { name(k); raw(b ? "true" : "false"); }
+  // v rounded to `decimals` places (0..6), e.g. fixed("cal_hz", -1.25, 1) -> -1.3
+  void fixed(const char* k, double v, uint8_t decimals) { name(k); fix(v, decimals); }
+  // Fixed-point integer v / 10^decimals (0..6), e.g. scaled("hz", 703860000, 2) -> 7038600.00
+  void scaled(const char* k, long long v, uint8_t decimals) { name(k); scale(v, decimals); }
+
+  void finish() {
+    if (len_) sink_(buf_, len_);
+    len_ = 0;
+  }
+
+private:
+  void put(char c) {
+    if (len_ == cap_) finish();
+    buf_[len_++] = c;
+  }
+
+  void raw(const char* s) {
+    while (*s) put(*s++);
+  }
+
+  // Comma before every element but the first at this depth (32 levels max).
+  void sep() {
+    uint32_t bit = 1UL << (depth_ & 31);
+    if (first_ & bit) first_ &= ~bit;
+    else put(',');
+  }
+
+  void name(const char* k) {
+    sep();
+    str(k);
+    put(':');
+  }
+
+  void open(const char* key, char c) {
+    if (key) name(key); else if (depth_) sep();
+    put(c);
+    depth_++;
+    first_ |= 1UL << (depth_ & 31);
+  }
+
+  void close(char c) {
+    depth_--;
+    put(c);
+  }
+
+  void str(const char* s) {
+    static const char DIGITS[] = "0123456789abcdef";
+    put('"');
+    for (; s && *s; s++) {
+      uint8_t c = (uint8_t)*s;
+      switch (c) {
+        case '"':  raw("\\\""); break;
+        case '\\': raw("\\\\"); break;
+        case '\b': raw("\\b"); break;
+        case '\f': raw("\\f"); break;
+        case '\n': raw("\\n"); break;
+        case '\r': raw("\\r"); break;
+        case '\t': raw("\\t"); break;
+        default:
+          if (c < 0x20) {
+            raw("\\u00");
+            put(DIGITS[c >> 4]);
+            put(DIGITS[c & 15]);
+          } else {
+            put((char)c);   // UTF-8 passes through untouched
+          }
+      }
+    }
+    put('"');
+  }
+
+  void unum(uint64_t v, uint8_t minDigits = 1) {
+    char tmp[21];
+    uint8_t n = 0;
+    do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v || n < minDigits);
+    while (n) put(tmp[--n]);
+  }
+
+  void num(long long v) {
+    if (v < 0) { put('-'); unum(0 - (unsigned long long)v); }
+    else unum((uint64_t)v);
+  }
+
+  static uint32_t pow10i(uint8_t d) {
+    static const uint32_t POW10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    return POW10[d];
+  }
+
+  void scale(long long v, uint8_t decimals) {
+    if (decimals > 6) decimals = 6;
+    if (v < 0) put('-');
+    uint64_t a = v < 0 ? 0 - (unsigned long long)v : (uint64_t)v;
+    unum(a / pow10i(decimals));
+    if (decimals) {
+      put('.');
+      unum(a % pow10i(decimals), decimals);
+    }
+  }
+
+  void fix(double v, uint8_t decimals) {
+    if (decimals > 6) decimals = 6;
+    if (!(v == v)) { raw("null"); return; }   // NaN is not JSON
+    bool neg = v < 0;
+    double a = (neg ? -v : v) * pow10i(decimals) + 0.5;
+    if (a >= 9.2e18) { raw("null"); return; }
+    uint64_t scaled = (uint64_t)a;
+    if (neg && scaled) put('-');
+    unum(scaled / pow10i(decimals));
+    if (decimals) {
+      put('.');
+      unum(scaled % pow10i(decimals), decimals);
+    }
+  }
+
+  char* buf_;
+  size_t cap_;
+  size_t len_ = 0;
+  Sink sink_;
+  uint8_t depth_ = 0;
+  uint32_t first_ = 1;   // bit d set: nothing written yet at depth d
+};
@@ -1,30 +1,37 @@
 #include <Arduino.h>
-#include <WiFi.h>
-#include <WebServer.h>
-#include <ESPmDNS.h>
-#include <Preferences.h>
-#include <Wire.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <time.h>
+#include <algorithm>
 
-#include <DNSServer.h>
-
-#include <si5351.h>
 #include <JTEncode.h>
-#include <Adafruit_NeoPixel.h>
 
-// ---------- LED SETTINGS ----------
-#define LED_PIN 48
-Adafruit_NeoPixel rgb(1, LED_PIN, NEO_GRBW + NEO_KHZ800);
+#include "hal.h"
+#include "json_reader.h"
+#include "json_writer.h"
+#include "metrics_writer.h"
+#include "web_ui.h"
 
 // ---------- HOSTNAME ----------
 static const char* HOSTNAME = "ESP32WSPR";   // -> http://ESP32WSPR.local/
 
 // ---------- WSPR CONSTANTS ----------
-static const double TONE_SPACING_HZ = 1.4648;
-// WSPR symbol is ~0.682666s. Use micros() scheduling to avoid drift/overrun.
-static const uint32_t SYMBOL_PERIOD_US = 683000UL;
-
-static const uint32_t SI5351_CRYSTAL = 25000000UL;
+// WSPR symbol is exactly 8192/12000 s (682666.67 us). Edges are computed from
+// the frame start so the fractional microsecond never accumulates.
+static const int WSPR_SYMBOL_COUNT = 162;
+static inline int64_t symbolEdgeUs(int i) { return ((int64_t)i * 2048000LL) / 3; }
+
+// Symbol engine: dedicated task on core 1, above everything else on that core.
+static const int SYMBOL_TASK_CORE = 1;
+static const uint8_t SYMBOL_TASK_PRIO = 24;   // configMAX_PRIORITIES - 1
+// Lead time between arming the engine and the first symbol edge.
+static const int64_t SYMBOL_START_LEAD_US = 5000;
+// WSPR frames start 1 s after the even minute. The beacon wakes
+// TX_PREP_LEAD_US early to load the Si5351, then the symbol
+// engine takes the last stretch with a precise wait.
+static const int64_t TX_START_OFFSET_US = 1000000;
+static const int64_t TX_PREP_LEAD_US = 250000;
+static const int64_t TX_MAX_LATE_US = 2000000;   // later than this: skip the slot
 
 // ---------- DEFAULTS ----------
 static const char* DEFAULT_CALL = "M0DQW";
@@ -34,119 +41,692 @@ static const uint8_t DEFAULT_PWR_DBM = 10;
 static const char* DEFAULT_NTP_SERVER = "pool.ntp.org";
 
 // ---------- Band table (WSPR dial frequencies) ----------
-struct BandDef { const char* name; double dial_hz; };
-static const BandDef BANDS[] = {
-  {"160m",  1836600.0},
-  {"80m",   3568600.0},
-  {"60m",   5287200.0},
-  {"40m",   7038600.0},
-  {"30m",  10138700.0},
-  {"20m",  14095600.0},
-  {"17m",  18104600.0},
-  {"15m",  21094600.0},
-  {"12m",  24924600.0},
-  {"10m",  28124600.0},
-  {"6m",   50293000.0},
+// Frequencies are exact integers, fixed at compile time. Dials are kept in
+// centi-Hz; tone and carrier maths runs in FREQ_Q units (centi-Hz with 8
+// fractional bits), in which the 12000/8192 Hz tone spacing is exact too.
+// The band plan follows the IARU region chosen at build time
+// (-DWSPR_IARU_REGION=1|2|3, WSJT-X defaults); only 60m differs.
+#ifndef WSPR_IARU_REGION
+#define WSPR_IARU_REGION 1
+#endif
+static_assert(WSPR_IARU_REGION >= 1 && WSPR_IARU_REGION <= 3, "WSPR_IARU_REGION must be 1, 2 or 3");
+
+static constexpr int64_t FREQ_Q_PER_HZ = 100LL * 256;
+static constexpr int64_t centiHz(int64_t hz) { return hz * 100; }
+static constexpr int64_t centiHzToQ(int64_t chz) { return chz * 256; }
+static constexpr int64_t dial60mHz(int region) { return region == 1 ? 5287200 : 5364700; }
+
+// Tone t sits t * 12000/8192 Hz above the carrier.
+static constexpr int64_t toneOffsetQ(int t) { return t * 12000LL * FREQ_Q_PER_HZ / 8192; }
+static constexpr int64_t TONE_OFFSET_Q[4] = { toneOffsetQ(0), toneOffsetQ(1), toneOffsetQ(2), toneOffsetQ(3) };
+static_assert(toneOffsetQ(1) * 8192 == 12000LL * FREQ_Q_PER_HZ, "tone spacing must be exact");
+
+struct BandDef { const char* name; int64_t dial_chz; };
+static constexpr BandDef BANDS[] = {
+  {"160m", centiHz(1836600)},
+  {"80m",  centiHz(3568600)},
+  {"60m",  centiHz(dial60mHz(WSPR_IARU_REGION))},
+  {"40m",  centiHz(7038600)},
+  {"30m",  centiHz(10138700)},
+  {"20m",  centiHz(14095600)},
+  {"17m",  centiHz(18104600)},
+  {"15m",  centiHz(21094600)},
+  {"12m",  centiHz(24924600)},
+  {"10m",  centiHz(28124600)},
+  {"6m",   centiHz(50293000)},
 };
 static const size_t NUM_BANDS = sizeof(BANDS) / sizeof(BANDS[0]);
 
 // ---------- GLOBALS ----------
-Si5351 si5351;
 JTEncode jt;
-uint8_t symbols[162];
-
-WebServer server(80);
-Preferences prefs;
 
 // Captive portal DNS
-DNSServer dnsServer;
-static const byte DNS_PORT = 53;
 bool captivePortalActive = false;
 
-// Settings (loaded from NVS)
-String wifiSsid;
-String wifiPass;
-
-String CALLSIGN;
-String LOCATOR;
+// Settings (loaded from NVS). Fixed arrays sized as in the settings blob:
+// nothing here touches the heap once booted.
+char wifiSsid[33];
+char wifiPass[65];
+// Last AP joined (reconnects skip the scan) and optional static IPv4,
+// packed a.b.c.d -> (a << 24) | ... | d.
+uint8_t staBssid[6];
+uint8_t staChannel = 0;      // 0: nothing cached
+uint32_t staIp = 0;          // 0: DHCP
+uint32_t staGateway = 0;
+uint32_t staNetmask = 0;
+uint32_t staDns = 0;
+
+char CALLSIGN[12];
+char LOCATOR[8];
 uint8_t POWER_DBM;
 
 size_t bandIndex = 3; // default 40m
 
+// Slot plan: one band, coordinated hopping, or a custom 720-slot day
+enum class SchedMode : uint8_t { Single = 0, Hop = 1, Custom = 2 };
+SchedMode schedMode = SchedMode::Single;
+uint16_t hopMask = 0x03FF;   // bands in the hop rotation (bit = band index)
+char customPlan[720 + 1];    // 720 chars: '0'-'9','a' band index, '-' off
+
 // per-band calibration offsets (Hz)
 double bandCalHz[NUM_BANDS];
 
+// Extra outputs: CLK1 and CLK2 each key their own fixed band alongside CLK0
+// in every planned slot (OUT_OFF: unused). outCalHz trims each output
+// (CLK0..2) on top of the band calibration, for its own filter/PA path.
+static const uint8_t TX_OUTPUTS = 3;
+static const uint8_t OUT_OFF = 0xFF;
+uint8_t extraBand[TX_OUTPUTS - 1] = { OUT_OFF, OUT_OFF };
+double outCalHz[TX_OUTPUTS];
+
 // TX control
 bool txEnabled = false;      // default OFF
 bool txEverySlot = false;    // default alternate
+uint8_t txPct = 100;         // share of planned slots keyed (WSJT-X "Tx %")
 
 // NTP server
-String ntpServer = DEFAULT_NTP_SERVER;
+char ntpServer[64];
 
 // per-TX random offset in Hz within window
 double sessionFreqOffsetHz = 0.0;
 
 // ---------- Helpers ----------
-static String htmlEscape(const String& s) {
-  String o; o.reserve(s.length());
-  for (size_t i = 0; i < s.length(); i++) {
-    char c = s[i];
-    switch (c) {
-      case '&': o += "&amp;"; break;
-      case '<': o += "&lt;"; break;
-      case '>': o += "&gt;"; break;
-      case '"': o += "&quot;"; break;
-      case '\'': o += "&#39;"; break;
-      default: o += c; break;
-    }
-  }
-  return o;
+// Held while touching state that the web handlers (network task) read.
+struct StateLock {
+  StateLock()  { hal::stateLock(); }
+  ~StateLock() { hal::stateUnlock(); }
+};
+
+// Serial.printf() mallocs a buffer for any line past 64 chars; log lines
+// are formatted on the stack instead (longer ones are cut).
+static void logf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+static void logf(const char* fmt, ...) {
+  char line[160];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (n > 0) Serial.write(line, min((size_t)n, sizeof(line) - 1));
 }
 
 static bool timeValid() {
-  time_t now; time(&now);
+  time_t now = hal::wallTime();
   return (now > 1000000000); // sanity threshold
 }
 
 // Place carrier near middle of 200 Hz WSPR window: dial + 100 Hz
-static double wsprBaseHz() {
-  return BANDS[bandIndex].dial_hz + 100.0;
+static int64_t wsprBaseQ(size_t band) {
+  return centiHzToQ(BANDS[band].dial_chz + centiHz(100));
+}
+
+// keys: cal0, cal1, ... cal10
+static const char* keyCalForBand(size_t idx, char (&key)[8]) {
+  snprintf(key, sizeof(key), "cal%u", (unsigned)idx);
+  return key;
+}
+
+// Calibration offsets (per band, per output) in Hz. Both add onto the
+// carrier, so an unbounded one could drive a divider denominator to zero.
+static const double CAL_MAX_HZ = 10000.0;
+
+static bool isValidCalHz(double hz) {
+  return isfinite(hz) && fabs(hz) <= CAL_MAX_HZ;
 }
 
-static String keyCalForBand(size_t idx) {
-  // keys: cal0, cal1, ... cal10
-  return "cal" + String((int)idx);
+// A form field holding one calibration value and nothing else.
+static bool parseCalHz(const char* text, double* hz) {
+  char* end;
+  *hz = strtod(text, &end);
+  if (end == text) return false;
+  while (isspace((unsigned char)*end)) end++;
+  return !*end && isValidCalHz(*hz);
+}
+
+// WSPR carries 0-60 dBm in steps ending in 0, 3 or 7; anything else would
+// be rounded by the encoder and reported as a power never set.
+static bool isValidPowerDbm(long dbm) {
+  return dbm >= 0 && dbm <= 60 && (dbm % 10 == 0 || dbm % 10 == 3 || dbm % 10 == 7);
 }
 
 // ---------- LED CONTROL ----------
+// The beacon only records what it is doing; ledPattern() (LED PATTERNS,
+// below) turns that into colour on the HAL's low-priority LED task, so an
+// LED update never runs on the beacon or symbol path.
+enum class LedMode : uint8_t { Off, Idle, Tx };
+static volatile LedMode ledMode = LedMode::Off;
+static const uint32_t LED_PERIOD_MS = 50;
+
 void ledOff() {
-  rgb.setPixelColor(0, 0, 0, 0);
-  rgb.show();
+  ledMode = LedMode::Off;
 }
 void ledIdle() {
-  rgb.setPixelColor(0, 0, 20, 0);
-  rgb.show();
+  ledMode = LedMode::Idle;
 }
 void ledTx() {
-  rgb.setPixelColor(0, 20, 0, 0);
-  rgb.show();
+  ledMode = LedMode::Tx;
+}
+
+// ---------- POWER ----------
+// Between frames the beacon only blocks on its queue, so the chip can drop
+// to POWER_MIN_MHZ and light-sleep with the WiFi modem dozing
+// (-DWSPR_POWER_SAVE=0 keeps it at full clock). Every wait is a timer
+// wakeup and waitForNextSlot() still returns TX_PREP_LEAD_US ahead; from
+// there to the end of the frame the beacon holds full clock and no sleep,
+// so prep and symbol timing are the same as without power saving.
+#ifndef WSPR_POWER_SAVE
+#define WSPR_POWER_SAVE 1
+#endif
+static const uint16_t POWER_MAX_MHZ = 240;
+static const uint16_t POWER_MIN_MHZ = 80;
+
+struct PowerStats {
+  hal::PowerInfo info;
+  int64_t heldUs;        // full clock for prep + frame, finished holds
+  int64_t heldSinceUs;   // monoUs the current hold began, -1 if none
+  int64_t keyedUs;       // RF on, finished frames
+  int64_t keyedSinceUs;
+};
+static PowerStats power = { { false, false, 0, 0 }, 0, -1, 0, -1 };
+
+void powerBegin() {
+  hal::cpuMeterBegin();
+#if WSPR_POWER_SAVE
+  power.info = hal::powerBegin(POWER_MAX_MHZ, POWER_MIN_MHZ, true);
+  if (!power.info.dfs) {
+    Serial.println("Power: full clock, power management not in this build");
+    return;
+  }
+  logf("Power: %u-%u MHz, light sleep %s\n", power.info.minMhz, power.info.maxMhz,
+       power.info.lightSleep ? "on" : "unavailable");
+#else
+  Serial.println("Power: full clock (WSPR_POWER_SAVE=0)");
+#endif
+}
+
+// Brackets prep + frame.
+void powerFull(bool on) {
+  if (on == (power.heldSinceUs >= 0)) return;
+  hal::powerHold(on);
+  if (on) {
+    power.heldSinceUs = hal::monoUs();
+  } else {
+    power.heldUs += hal::monoUs() - power.heldSinceUs;
+    power.heldSinceUs = -1;
+  }
+}
+
+static int64_t spanUs(int64_t doneUs, int64_t sinceUs, int64_t nowUs) {
+  return doneUs + (sinceUs >= 0 ? nowUs - sinceUs : 0);
 }
 
 // ---------- RF CONTROL ----------
 void rfOff() {
-  si5351.output_enable(SI5351_CLK0, 0);
-  si5351.set_freq(0, SI5351_CLK0);
+  if (power.keyedSinceUs >= 0) {
+    power.keyedUs += hal::monoUs() - power.keyedSinceUs;
+    power.keyedSinceUs = -1;
+  }
+  for (uint8_t k = 0; k < TX_OUTPUTS; k++) {
+    hal::radioEnable((hal::RadioClk)k, false);
+    hal::radioStop((hal::RadioClk)k);
+  }
   Serial.println("RF state: OFF");
   ledIdle();
 }
-void rfOn() {
-  si5351.output_enable(SI5351_CLK0, 1);
+void rfOn(const hal::RadioClk* clks, uint8_t n) {
+  for (uint8_t k = 0; k < n; k++) hal::radioEnable(clks[k], true);
+  if (power.keyedSinceUs < 0) power.keyedSinceUs = hal::monoUs();
   Serial.println("RF state: ON");
   ledTx();
 }
 
+// ---------- FRAME PLAN ----------
+// Everything the symbol loop needs is computed once per frame, before the
+// slot starts: PLLA is held at a fixed frequency and each of the four tones
+// is a fractional divider of the output's multisynth, kept as the 8-byte
+// register image the Si5351 expects at its MSx parameter block. Per symbol
+// only the bytes that differ from what the chip already holds are written,
+// one I2C burst per keyed output. All outputs share PLLA and the symbol
+// edges; each has its own multisynth, band, calibration and scatter.
+static const uint64_t FRAME_PLL_HZ = hal::RADIO_PLL_HZ;
+static const uint32_t MS_MAX_DENOM = 1048575UL;  // 20-bit P3
+static const uint8_t MS_REG_BYTES = hal::RADIO_MS_BYTES;
+
+struct FramePlan {
+  bool valid = false;
+  hal::RadioClk clk = hal::CLK0;
+  size_t band = 0;
+  int32_t calCentiHz = 0;
+  int32_t scatterHz = 0;
+  int64_t carrierQ = 0;         // tone 0, FREQ_Q units
+  bool sharedDenom = false;     // one P3 for all tones (small deltas)
+  uint8_t tone[4][MS_REG_BYTES];
+};
+// [0] is CLK0 on the slot's band, then one plan per extra output keying
+// this frame. The set stands or falls with framePlans[0].valid.
+static FramePlan framePlans[TX_OUTPUTS];
+static uint8_t framePlanCount = 0;
+
+// MSx register bytes as currently held by the chip, per output (valid
+// after priming).
+static uint8_t msShadow[TX_OUTPUTS][MS_REG_BYTES];
+
+// Tones preferably share one P3 so that a tone change only touches the
+// P1/P2 bytes. The denominator is picked from the top of the 20-bit range
+// to minimise the worst tone error. From roughly 17m up one multisynth LSB
+// approaches the tone spacing and no shared denominator fits; those bands
+// fall back to a best-rational P3 per tone (full 8-byte bursts).
+static const uint32_t MS_DENOM_SEARCH = 16384;
+static const double MS_COMMON_TOL_HZ = 0.05;
+
+// Returns the chosen denominator; *worstDiv is the worst divider error.
+// The residue (num * c) % den steps down by num % den with each c, so the
+// search needs only the divisions of its first candidate.
+static uint32_t commonDenominator(uint64_t num, const uint64_t den[4], double* worstDiv) {
+  uint64_t r[4], m[4];
+  for (int t = 0; t < 4; t++) {
+    r[t] = num % den[t];
+    m[t] = (r[t] * MS_MAX_DENOM) % den[t];
+  }
+  uint32_t best = MS_MAX_DENOM;
+  double bestErr = 1e30;
+  for (uint32_t c = MS_MAX_DENOM; c > MS_MAX_DENOM - MS_DENOM_SEARCH; c--) {
+    double worst = 0.0;
+    for (int t = 0; t < 4; t++) {
+      uint64_t e = min(m[t], den[t] - m[t]);
+      double err = (double)e / (double)den[t];
+      if (err > worst) worst = err;
+      m[t] = m[t] >= r[t] ? m[t] - r[t] : m[t] + den[t] - r[t];
+    }
+    worst /= c;
+    if (worst < bestErr) { bestErr = worst; best = c; }
+  }
+  *worstDiv = bestErr;
+  return best;
+}
+
+// Best rational approximation num/den ~= b/c with c <= maxDen (last
+// continued-fraction convergent inside the bound).
+static uint32_t bestDenominator(uint64_t num, uint64_t den, uint32_t maxDen) {
+  uint64_t h0 = 0, h1 = 1, k0 = 1, k1 = 0;
+  while (den) {
+    uint64_t a = num / den;
+    uint64_t h2 = a * h1 + h0;
+    uint64_t k2 = a * k1 + k0;
+    if (k2 > maxDen) break;
+    h0 = h1; h1 = h2; k0 = k1; k1 = k2;
+    uint64_t r = num % den; num = den; den = r;
+  }
+  return k1 ? (uint32_t)k1 : 1;
+}
+
+// Multisynth divider num/den as a + b/c, packed into the MSx register
+// layout (R_DIV = 1, DIVBY4 off).
+static void msRegImage(uint64_t num, uint64_t den, uint32_t c, uint8_t img[MS_REG_BYTES]) {
+  uint32_t a = (uint32_t)(num / den);
+  uint32_t b = (uint32_t)(((num % den) * c + den / 2) / den);
+  if (b >= c) { a++; b -= c; }
+
+  const uint32_t f128 = (uint32_t)((128ULL * b) / c);
+  const uint32_t p1 = 128UL * a + f128 - 512UL;
+  const uint32_t p2 = 128UL * b - c * f128;
+  const uint32_t p3 = c;
+
+  img[0] = (p3 >> 8) & 0xFF;
+  img[1] = p3 & 0xFF;
+  img[2] = (p1 >> 16) & 0x03;
+  img[3] = (p1 >> 8) & 0xFF;
+  img[4] = p1 & 0xFF;
+  img[5] = ((p3 >> 12) & 0xF0) | ((p2 >> 16) & 0x0F);
+  img[6] = (p2 >> 8) & 0xFF;
+  img[7] = p2 & 0xFF;
+}
+
+static void planOutput(FramePlan& p, hal::RadioClk clk, size_t band) {
+  p.clk = clk;
+  p.band = band;
+  p.calCentiHz = (int32_t)lround((bandCalHz[band] + outCalHz[clk]) * 100.0);
+  p.scatterHz = random(0, 100);
+  p.carrierQ = wsprBaseQ(band) + centiHzToQ(p.calCentiHz) + p.scatterHz * FREQ_Q_PER_HZ;
+
+  // Divider PLL/f with f in FREQ_Q units: one table lookup and one add per
+  // tone, no rounding anywhere before the register fit.
+  const uint64_t num = FRAME_PLL_HZ * (uint64_t)FREQ_Q_PER_HZ;
+  uint64_t den[4];
+  for (int t = 0; t < 4; t++) {
+    den[t] = (uint64_t)(p.carrierQ + TONE_OFFSET_Q[t]);
+  }
+  double worstDiv = 0.0;
+  const uint32_t c = commonDenominator(num, den, &worstDiv);
+  const double carrierHz = (double)p.carrierQ / FREQ_Q_PER_HZ;
+  const double worstHz = worstDiv * carrierHz * carrierHz / FRAME_PLL_HZ;
+  p.sharedDenom = (worstHz <= MS_COMMON_TOL_HZ);
+  for (int t = 0; t < 4; t++) {
+    uint32_t ct = p.sharedDenom ? c : bestDenominator(num % den[t], den[t], MS_MAX_DENOM);
+    msRegImage(num, den[t], ct, p.tone[t]);
+  }
+  p.valid = true;
+}
+
+// CLK0 on `band`, plus every extra output whose band differs from it.
+void buildFramePlans(size_t band) {
+  framePlanCount = 0;
+  planOutput(framePlans[framePlanCount++], hal::CLK0, band);
+  for (uint8_t k = 1; k < TX_OUTPUTS; k++) {
+    uint8_t b = extraBand[k - 1];
+    if (b == OUT_OFF || b == band) continue;   // one signal per band
+    planOutput(framePlans[framePlanCount++], (hal::RadioClk)k, b);
+  }
+}
+
+// Lock PLLA and load the first tone of every output in full; from here on
+// only deltas are written. Called with the outputs still muted.
+static void primeFramePlans(uint8_t firstTone) {
+  for (uint8_t k = 0; k < framePlanCount; k++) {
+    const FramePlan& p = framePlans[k];
+    hal::radioLoadMs(p.clk, p.tone[firstTone]);
+    memcpy(msShadow[p.clk], p.tone[firstTone], MS_REG_BYTES);
+  }
+}
+
+// ---------- MESSAGE CACHE ----------
+// A plain call with a 4-char locator sends Type 1 (call, square, power)
+// only. A 6-char locator alternates Type 1 with Type 3 (hashed call, full
+// locator, power); a compound call (PJ4/K1ABC, K1ABC/P) alternates Type 2
+// (full call, power) with Type 3, as WSJT-X does. JTEncode (1.3+) picks
+// the type from the call it is handed: '/' -> Type 2, "<call>" -> Type 3.
+// Encoded frames are cached by their inputs and only re-encoded when a
+// saved setting changes them; a frame just picks the next message.
+struct WsprMessage {
+  uint8_t type = 0;              // 1, 2 or 3; 0 = free
+  char call[13];                 // as given to the encoder, e.g. "<K1ABC>"
+  char loc[7];
+  uint8_t pwr;
+  uint8_t symbols[WSPR_SYMBOL_COUNT];
+};
+static const size_t MSG_CACHE_SIZE = 4;
+static const size_t MSG_SEQ_MAX = 2;
+static WsprMessage msgCache[MSG_CACHE_SIZE];
+static const WsprMessage* msgSeq[MSG_SEQ_MAX];   // alternation order
+static uint8_t msgSeqLen = 0;
+static uint32_t msgFrames = 0;     // frames keyed; selects the next message
+static uint32_t msgEncodes = 0;    // cache misses since boot
+
+// Cached frame for (type, call, loc, pwr), encoding it on a miss. Entries
+// listed in keep (the sequence being built) are never evicted.
+static const WsprMessage* cachedMessage(uint8_t type, const char* call, const char* loc,
+                                        uint8_t pwr, const WsprMessage* const* keep,
+                                        size_t nKeep) {
+  WsprMessage* victim = nullptr;
+  for (size_t i = 0; i < MSG_CACHE_SIZE; i++) {
+    WsprMessage& m = msgCache[i];
+    if (m.type == type && m.pwr == pwr && !strcmp(m.call, call) && !strcmp(m.loc, loc)) {
+      return &m;
+    }
+    bool kept = false;
+    for (size_t k = 0; k < nKeep; k++) kept |= (keep[k] == &m);
+    if (!kept && (!victim || m.type == 0)) victim = &m;
+  }
+  victim->type = type;
+  strlcpy(victim->call, call, sizeof(victim->call));
+  strlcpy(victim->loc, loc, sizeof(victim->loc));
+  victim->pwr = pwr;
+  jt.wspr_encode(call, loc, pwr, victim->symbols);
+  msgEncodes++;
+  return victim;
+}
+
+// Rebuilds the message sequence from CALLSIGN/LOCATOR/POWER_DBM. Runs on
+// the beacon task, which is the only writer of those and of the cache.
+void rebuildMessages() {
+  char call[11], loc4[5], hashed[13];   // longest call: ABC/K1ABCD
+  strlcpy(call, CALLSIGN, sizeof(call));
+  strlcpy(loc4, LOCATOR, sizeof(loc4));
+  snprintf(hashed, sizeof(hashed), "<%s>", call);
+  const bool compound = strchr(call, '/') != nullptr;
+  const bool loc6 = strlen(LOCATOR) == 6;
+
+  const WsprMessage* seq[MSG_SEQ_MAX] = {};
+  size_t n = 0;
+  seq[n] = cachedMessage(compound ? 2 : 1, call, loc4, POWER_DBM, seq, n);
+  n++;
+  if (compound || loc6) {
+    seq[n] = cachedMessage(3, hashed, LOCATOR, POWER_DBM, seq, n);
+    n++;
+  }
+
+  StateLock lock;
+  for (size_t i = 0; i < n; i++) msgSeq[i] = seq[i];
+  msgSeqLen = (uint8_t)n;
+}
+
 // ---------- NVS LOAD/SAVE ----------
+// All settings live in one CRC-checked blob, read in one go at boot and
+// rewritten only when its bytes differ from what flash already holds. New
+// fields go at the end and bump SETTINGS_VERSION: an older, shorter blob
+// still loads and the missing tail keeps its defaults. The CRC only shows
+// the blob is one we wrote, so every field is validated again on load, by
+// the same rules as /config. Boards still holding the original
+// one-key-per-setting layout are migrated on first boot.
+static const char* KV_NS = "esp32wspr";
+static const char* KV_BLOB = "cfg";
+static const uint16_t SETTINGS_MAGIC = 0x5753;   // "WS"
+static const uint8_t SETTINGS_VERSION = 1;
+
+static bool isValidHopMask(long mask);
+static bool isValidPlan(const char* plan);
+
+struct SettingsBlob {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint16_t size;          // bytes covered by crc, header included
+  uint16_t reserved2;
+  uint32_t crc;           // CRC-32 of the first `size` bytes, crc = 0
+  char ssid[33];
+  char pass[65];
+  char call[12];
+  char loc[8];
+  char ntp[64];
+  uint8_t pwr;
+  uint8_t band;
+  uint8_t txEnabled;
+  uint8_t txEverySlot;
+  uint8_t schedMode;
+  uint16_t hopMask;
+  double calHz[NUM_BANDS];
+  char plan[720 + 1];     // customPlan, one char per slot of the day
+  uint8_t staBssid[6];
+  uint8_t staChannel;
+  uint32_t staIp;
+  uint32_t staGateway;
+  uint32_t staNetmask;
+  uint32_t staDns;
+  double outCalHz[TX_OUTPUTS];
+  uint8_t extraBand[TX_OUTPUTS - 1];
+  uint8_t txPct;
+};
+
+// Per-key layout written before the blob; read once, then erased.
+static const char* LEGACY_KEYS[] = {
+  "ssid", "pass", "call", "loc", "pwr", "band", "txen", "txall", "ntp",
+  "sched", "hopmask", "plan",
+};
+
+static SettingsBlob storedSettings;   // image of what flash holds
+
+struct SettingsStats {
+  uint32_t loadUs = 0;
+  uint32_t saveUs = 0;     // last write that reached flash
+  uint32_t writes = 0;
+  uint32_t skipped = 0;    // saves with nothing changed
+  bool migrated = false;
+};
+static SettingsStats settingsStats;
+
+static uint32_t crc32(const uint8_t* p, size_t n) {
+  uint32_t c = 0xFFFFFFFFUL;
+  while (n--) {
+    c ^= *p++;
+    for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320UL & (0 - (c & 1)));
+  }
+  return ~c;
+}
+
+// Current settings as a sealed blob; zero-filled so equal settings give
+// equal bytes.
+static void settingsToBlob(SettingsBlob& b) {
+  memset(&b, 0, sizeof(b));
+  b.magic = SETTINGS_MAGIC;
+  b.version = SETTINGS_VERSION;
+  b.size = sizeof(b);
+  strlcpy(b.ssid, wifiSsid, sizeof(b.ssid));
+  strlcpy(b.pass, wifiPass, sizeof(b.pass));
+  strlcpy(b.call, CALLSIGN, sizeof(b.call));
+  strlcpy(b.loc, LOCATOR, sizeof(b.loc));
+  strlcpy(b.ntp, ntpServer, sizeof(b.ntp));
+  b.pwr = POWER_DBM;
+  b.band = (uint8_t)bandIndex;
+  b.txEnabled = txEnabled;
+  b.txEverySlot = txEverySlot;
+  b.schedMode = (uint8_t)schedMode;
+  b.hopMask = hopMask;
+  for (size_t i = 0; i < NUM_BANDS; i++) b.calHz[i] = bandCalHz[i];
+  strlcpy(b.plan, customPlan, sizeof(b.plan));
+  memcpy(b.staBssid, staBssid, sizeof(b.staBssid));
+  b.staChannel = staChannel;
+  b.staIp = staIp;
+  b.staGateway = staGateway;
+  b.staNetmask = staNetmask;
+  b.staDns = staDns;
+  for (uint8_t k = 0; k < TX_OUTPUTS; k++) b.outCalHz[k] = outCalHz[k];
+  memcpy(b.extraBand, extraBand, sizeof(b.extraBand));
+  b.txPct = txPct;
+  b.crc = crc32((const uint8_t*)&b, sizeof(b));
+}
+
+static void blobToSettings(SettingsBlob& b) {
+  b.ssid[sizeof(b.ssid) - 1] = 0;
+  b.pass[sizeof(b.pass) - 1] = 0;
+  b.call[sizeof(b.call) - 1] = 0;
+  b.loc[sizeof(b.loc) - 1] = 0;
+  b.ntp[sizeof(b.ntp) - 1] = 0;
+  b.plan[sizeof(b.plan) - 1] = 0;
+  strlcpy(wifiSsid, b.ssid, sizeof(wifiSsid));
+  strlcpy(wifiPass, b.pass, sizeof(wifiPass));
+  strlcpy(CALLSIGN, b.call, sizeof(CALLSIGN));
+  strlcpy(LOCATOR, b.loc, sizeof(LOCATOR));
+  strlcpy(ntpServer, b.ntp, sizeof(ntpServer));
+  if (isValidPowerDbm(b.pwr)) POWER_DBM = b.pwr;
+  bandIndex = b.band < NUM_BANDS ? b.band : 3;
+  txEnabled = b.txEnabled;
+  txEverySlot = b.txEverySlot;
+  schedMode = b.schedMode <= (uint8_t)SchedMode::Custom ? (SchedMode)b.schedMode : SchedMode::Single;
+  if (isValidHopMask(b.hopMask)) hopMask = b.hopMask;
+  for (size_t i = 0; i < NUM_BANDS; i++) {
+    if (isValidCalHz(b.calHz[i])) bandCalHz[i] = b.calHz[i];
+  }
+  if (isValidPlan(b.plan)) strlcpy(customPlan, b.plan, sizeof(customPlan));
+  memcpy(staBssid, b.staBssid, sizeof(staBssid));
+  staChannel = b.staChannel;
+  staIp = b.staIp;
+  staGateway = b.staGateway;
+  staNetmask = b.staNetmask;
+  staDns = b.staDns;
+  for (uint8_t k = 0; k < TX_OUTPUTS; k++) {
+    if (isValidCalHz(b.outCalHz[k])) outCalHz[k] = b.outCalHz[k];
+  }
+  for (uint8_t k = 0; k < TX_OUTPUTS - 1; k++) {
+    extraBand[k] = b.extraBand[k] < NUM_BANDS ? b.extraBand[k] : OUT_OFF;
+  }
+  if (b.txPct >= 1 && b.txPct <= 100) txPct = b.txPct;
+}
+
+// Overlays the stored blob on b (pre-filled with defaults). False if there
+// is none or it fails the checks.
+static bool readBlob(SettingsBlob& b) {
+  SettingsBlob raw;
+  memset(&raw, 0, sizeof(raw));
+  size_t n = hal::kvGetBytes(KV_BLOB, &raw, sizeof(raw));
+  if (n < offsetof(SettingsBlob, ssid) || raw.magic != SETTINGS_MAGIC ||
+      raw.version > SETTINGS_VERSION || raw.size != n) {
+    return false;
+  }
+  uint32_t crc = raw.crc;
+  raw.crc = 0;
+  if (crc32((const uint8_t*)&raw, n) != crc) return false;
+  memcpy(&b, &raw, n);
+  return true;
+}
+
+static bool hasLegacySettings() {
+  for (const char* k : LEGACY_KEYS) if (hal::kvHas(k)) return true;
+  return false;
+}
+
+// The original layout, one NVS key per setting (defaults: current values).
+// Checked like the blob: whatever loads here is written straight back out.
+static void loadLegacySettings() {
+  strlcpy(wifiSsid, hal::kvGetString("ssid", "").c_str(), sizeof(wifiSsid));
+  strlcpy(wifiPass, hal::kvGetString("pass", "").c_str(), sizeof(wifiPass));
+
+  strlcpy(CALLSIGN, hal::kvGetString("call", DEFAULT_CALL).c_str(), sizeof(CALLSIGN));
+  strlcpy(LOCATOR,  hal::kvGetString("loc",  DEFAULT_LOC).c_str(), sizeof(LOCATOR));
+  uint8_t pwr = hal::kvGetU8("pwr", DEFAULT_PWR_DBM);
+  if (isValidPowerDbm(pwr)) POWER_DBM = pwr;
+
+  bandIndex = (size_t)hal::kvGetU8("band", 3);
+  if (bandIndex >= NUM_BANDS) bandIndex = 3;
+
+  // per-band calibration (override defaults)
+  for (size_t i = 0; i < NUM_BANDS; i++) {
+    char k[8];
+    double hz = hal::kvHas(keyCalForBand(i, k)) ? hal::kvGetDouble(k, bandCalHz[i]) : bandCalHz[i];
+    if (isValidCalHz(hz)) bandCalHz[i] = hz;
+  }
+
+  txEnabled   = hal::kvGetBool("txen", false);    // default OFF
+  txEverySlot = hal::kvGetBool("txall", false);   // default alternate
+  strlcpy(ntpServer, hal::kvGetString("ntp", DEFAULT_NTP_SERVER).c_str(), sizeof(ntpServer));
+
+  schedMode  = (SchedMode)hal::kvGetU8("sched", (uint8_t)SchedMode::Single);
+  if ((uint8_t)schedMode > (uint8_t)SchedMode::Custom) schedMode = SchedMode::Single;
+  uint16_t mask = hal::kvGetU16("hopmask", hopMask);
+  if (isValidHopMask(mask)) hopMask = mask;
+  String plan = hal::kvGetString("plan", "");
+  if (isValidPlan(plan.c_str())) strlcpy(customPlan, plan.c_str(), sizeof(customPlan));
+}
+
+static void removeLegacySettings() {
+  for (const char* k : LEGACY_KEYS) hal::kvRemove(k);
+  char k[8];
+  for (size_t i = 0; i < NUM_BANDS; i++) hal::kvRemove(keyCalForBand(i, k));
+}
+
+void saveSettings();
+
 void loadSettings() {
+  const int64_t t0 = hal::monoUs();
+
+  // Defaults
+  wifiSsid[0] = 0;
+  wifiPass[0] = 0;
+  strlcpy(CALLSIGN, DEFAULT_CALL, sizeof(CALLSIGN));
+  strlcpy(LOCATOR, DEFAULT_LOC, sizeof(LOCATOR));
+  POWER_DBM = DEFAULT_PWR_DBM;
+  bandIndex = 3;                  // 40m
+  txEnabled = false;              // OFF
+  txEverySlot = false;            // alternate
+  strlcpy(ntpServer, DEFAULT_NTP_SERVER, sizeof(ntpServer));
+  schedMode = SchedMode::Single;
+  hopMask = 0x03FF;
+  customPlan[0] = 0;
+  memset(staBssid, 0, sizeof(staBssid));
+  staChannel = 0;
+  staIp = staGateway = staNetmask = staDns = 0;
+  for (uint8_t k = 0; k < TX_OUTPUTS; k++) outCalHz[k] = 0.0;
+  memset(extraBand, OUT_OFF, sizeof(extraBand));
+  txPct = 100;
+
   // Default per-band calibration (Hz)
   bandCalHz[0]  =  0.0;   // 160m
   bandCalHz[1]  =  0.0;   // 80m
@@ -160,709 +740,1838 @@ void loadSettings() {
   bandCalHz[9]  =  0.0;   // 10m
   bandCalHz[10] =  0.0;   // 6m
 
-  prefs.begin("esp32wspr", true);
+  SettingsBlob b;
+  settingsToBlob(b);
+
+  hal::kvBegin(KV_NS, true);
+  bool haveBlob = readBlob(b);
+  bool legacy = !haveBlob && hasLegacySettings();
+  if (haveBlob) blobToSettings(b);
+  else if (legacy) loadLegacySettings();
+  hal::kvEnd();
+
+  // Flash holds these settings (or nothing, which loads as the defaults).
+  settingsToBlob(storedSettings);
+  settingsStats.loadUs = (uint32_t)(hal::monoUs() - t0);
+
+  if (legacy) {
+    memset(&storedSettings, 0, sizeof(storedSettings));   // force the write
+    saveSettings();
+    hal::kvBegin(KV_NS, false);
+    removeLegacySettings();
+    hal::kvEnd();
+    settingsStats.migrated = true;
+    Serial.println("Settings migrated to the blob layout.");
+  }
+}
 
-  wifiSsid = prefs.getString("ssid", "");
-  wifiPass = prefs.getString("pass", "");
+void saveSettings() {
+  SettingsBlob b;
+  settingsToBlob(b);
+  if (!memcmp(&b, &storedSettings, sizeof(b))) {
+    StateLock lock;
+    settingsStats.skipped++;
+    return;
+  }
 
-  CALLSIGN  = prefs.getString("call", DEFAULT_CALL);
-  LOCATOR   = prefs.getString("loc",  DEFAULT_LOC);
-  POWER_DBM = (uint8_t)prefs.getUChar("pwr", DEFAULT_PWR_DBM);
+  const int64_t t0 = hal::monoUs();
+  hal::kvBegin(KV_NS, false);
+  hal::kvPutBytes(KV_BLOB, &b, sizeof(b));
+  hal::kvEnd();
+  storedSettings = b;
 
-  bandIndex = (size_t)prefs.getUChar("band", 3);
-  if (bandIndex >= NUM_BANDS) bandIndex = 3;
+  StateLock lock;
+  settingsStats.saveUs = (uint32_t)(hal::monoUs() - t0);
+  settingsStats.writes++;
+}
 
-  // per-band calibration (override defaults)
-  for (size_t i = 0; i < NUM_BANDS; i++) {
-    String k = keyCalForBand(i);
-    if (prefs.isKey(k.c_str())) bandCalHz[i] = prefs.getDouble(k.c_str(), bandCalHz[i]);
-  }
+// ---------- WIFI MANAGER ----------
+// Nothing waits on the station link. wifiService() starts an association
+// when one is due, and link up/down events come back through the command
+// queue (CmdType::WifiLink) into wifiOnLink(). A failed or dropped link
+// retries with exponential backoff. The BSSID and channel of the last good
+// link are kept in the settings blob, so boots and reconnects go straight
+// to that AP without a scan; if such an attempt fails, the next one scans.
+// The AP + captive portal come up when no SSID is stored, or when the
+// station has not had a link WIFI_AP_FALLBACK_MS after boot.
+static const uint32_t WIFI_ATTEMPT_MS = 15000;   // no event by then: failed
+static const uint32_t WIFI_BACKOFF_MIN_MS = 2000;
+static const uint32_t WIFI_BACKOFF_MAX_MS = 120000UL;
+static const uint32_t WIFI_AP_FALLBACK_MS = 10000;
+static const uint32_t WIFI_IDLE_POLL_MS = 60000;
+
+enum class WifiState : uint8_t { Idle, Connecting, Connected, Backoff };
+
+struct WifiStatus {
+  WifiState state;
+  uint32_t dueMs;          // next attempt (Idle/Backoff) or give-up (Connecting)
+  uint32_t backoffMs;
+  bool hintOk;             // next attempt may use the cached BSSID/channel
+  bool hinted;             // the current attempt does
+  uint32_t attemptMs;      // when the current attempt started
+  uint32_t lastAssocMs;    // attempt start -> IP, last good link
+  uint32_t connects;
+  uint32_t failures;
+  uint32_t drops;
+  uint8_t lastReason;
+};
+static WifiStatus wifi = { WifiState::Idle, 0, WIFI_BACKOFF_MIN_MS, true, false, 0, 0, 0, 0, 0, 0 };
 
-  txEnabled   = prefs.getBool("txen", false);    // default OFF
-  txEverySlot = prefs.getBool("txall", false);   // default alternate
-  ntpServer   = prefs.getString("ntp", DEFAULT_NTP_SERVER);
+// Boot milestones, ms after power-up (0: not reached yet).
+struct BootTimes {
+  uint32_t staUpMs;
+  uint32_t timeValidMs;
+};
+static BootTimes boot = { 0, 0 };
 
-  prefs.end();
-}
+static void onWifiLink(const hal::WifiLink& link);   // WiFi task -> queue
+static void startScan();
+void startApModeCaptivePortal();
+void ntpKick();
 
-void saveSettings() {
-  prefs.begin("esp32wspr", false);
+static void wifiOnLink(const hal::WifiLink& link);
 
-  prefs.putString("ssid", wifiSsid);
-  prefs.putString("pass", wifiPass);
+static const char* wifiStateName(WifiState s) {
+  switch (s) {
+    case WifiState::Connecting: return "connecting";
+    case WifiState::Connected:  return "connected";
+    case WifiState::Backoff:    return "backoff";
+    default:                    return "idle";
+  }
+}
 
-  prefs.putString("call", CALLSIGN);
-  prefs.putString("loc",  LOCATOR);
-  prefs.putUChar("pwr", POWER_DBM);
+static bool staHintValid() {
+  return staChannel != 0;
+}
 
-  prefs.putUChar("band", (uint8_t)bandIndex);
+static void formatIp(uint32_t ip, char out[16]) {
+  snprintf(out, 16, "%u.%u.%u.%u", (unsigned)(ip >> 24), (unsigned)(ip >> 16) & 255,
+           (unsigned)(ip >> 8) & 255, (unsigned)ip & 255);
+}
 
-  for (size_t i = 0; i < NUM_BANDS; i++) {
-    String k = keyCalForBand(i);
-    prefs.putDouble(k.c_str(), bandCalHz[i]);
+// Caller holds the state lock.
+static void wifiConnect(uint32_t nowMs) {
+  hal::WifiStaConfig cfg = {};
+  cfg.ssid = wifiSsid;
+  cfg.pass = wifiPass;
+  wifi.hinted = wifi.hintOk && staHintValid();
+  if (wifi.hinted) {
+    cfg.bssid = staBssid;
+    cfg.channel = staChannel;
   }
+  cfg.ip = staIp;
+  cfg.gateway = staGateway;
+  cfg.netmask = staNetmask;
+  cfg.dns = staDns ? staDns : staGateway;
+  logf("WiFi: connecting to '%s'%s\n", wifiSsid,
+       wifi.hinted ? " (cached AP)" : "");
+  hal::wifiStaConnect(HOSTNAME, cfg, onWifiLink);
+  wifi.state = WifiState::Connecting;
+  wifi.attemptMs = nowMs;
+  wifi.dueMs = nowMs + WIFI_ATTEMPT_MS;
+}
 
-  prefs.putBool("txen", txEnabled);
-  prefs.putBool("txall", txEverySlot);
-  prefs.putString("ntp", ntpServer);
+// Caller holds the state lock.
+static void wifiFail(uint32_t nowMs) {
+  wifi.failures++;
+  if (wifi.hinted) {
+    // The cached AP may be gone or have moved channel: scan next time.
+    wifi.hintOk = false;
+    wifi.state = WifiState::Backoff;
+    wifi.dueMs = nowMs;
+    Serial.println("WiFi: cached AP failed, rescanning");
+    return;
+  }
+  wifi.state = WifiState::Backoff;
+  wifi.dueMs = nowMs + wifi.backoffMs;
+  logf("WiFi: no link, retry in %lu s\n", (unsigned long)(wifi.backoffMs / 1000));
+  wifi.backoffMs = min(wifi.backoffMs * 2, WIFI_BACKOFF_MAX_MS);
+}
 
-  prefs.end();
+// Connect as soon as possible (boot, new credentials).
+void wifiKick() {
+  StateLock lock;
+  wifi.state = WifiState::Idle;
+  wifi.backoffMs = WIFI_BACKOFF_MIN_MS;
+  wifi.hintOk = true;
+  wifi.dueMs = hal::monoMs();
 }
 
-// ---------- WIFI + NTP ----------
-bool connectStaWithTimeout(uint32_t timeoutMs) {
-  if (wifiSsid.isEmpty()) {
-    Serial.println("No stored SSID; skipping STA connect.");
-    return false;
+// Runs on every beacon wakeup; cheap when nothing is due.
+void wifiService() {
+  uint32_t nowMs = hal::monoMs();
+  if (!captivePortalActive && wifi.connects == 0 &&
+      (!wifiSsid[0] || nowMs >= WIFI_AP_FALLBACK_MS)) {
+    startApModeCaptivePortal();
+  }
+  if ((int32_t)(nowMs - wifi.dueMs) < 0) return;
+
+  // A link event lost to a full command queue shows up as a stale state.
+  const bool up = hal::wifiStaConnected();
+  if ((wifi.state == WifiState::Connecting && up) || (wifi.state == WifiState::Connected && !up)) {
+    hal::WifiLink link = {};
+    link.up = up;
+    memcpy(link.bssid, staBssid, sizeof(link.bssid));
+    link.channel = staChannel;
+    wifiOnLink(link);
+    return;
   }
 
-  WiFi.mode(WIFI_AP_STA);
-  WiFi.setHostname(HOSTNAME);
-  WiFi.begin(wifiSsid.c_str(), wifiPass.c_str());
+  StateLock lock;
+  switch (wifi.state) {
+    case WifiState::Connecting:
+      wifiFail(nowMs);
+      break;
+    case WifiState::Idle:
+    case WifiState::Backoff:
+      if (!wifiSsid[0]) wifi.dueMs = nowMs + WIFI_IDLE_POLL_MS;
+      else wifiConnect(nowMs);
+      break;
+    case WifiState::Connected:
+      wifi.dueMs = nowMs + WIFI_IDLE_POLL_MS;   // events drive this state
+      break;
+  }
+}
 
-  Serial.printf("Connecting STA to '%s' (timeout %lus)\n", wifiSsid.c_str(), timeoutMs / 1000);
+// Milliseconds until wifiService() has something to do.
+static uint32_t wifiDueInMs() {
+  uint32_t nowMs = hal::monoMs();
+  int32_t d = (int32_t)(wifi.dueMs - nowMs);
+  if (!captivePortalActive && wifi.connects == 0 && nowMs < WIFI_AP_FALLBACK_MS) {
+    d = min(d, (int32_t)(WIFI_AP_FALLBACK_MS - nowMs));
+  }
+  return d > 0 ? (uint32_t)d : 0;
+}
 
-  uint32_t start = millis();
-  while (millis() - start < timeoutMs) {
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.printf("STA connected: %s\n", WiFi.localIP().toString().c_str());
-      return true;
+static void wifiOnLink(const hal::WifiLink& link) {
+  uint32_t nowMs = hal::monoMs();
+  if (!link.up) {
+    StateLock lock;
+    wifi.lastReason = link.reason;
+    if (wifi.state == WifiState::Connecting) {
+      // Our own leave from the previous link is not this attempt failing.
+      if (link.reason != hal::WIFI_REASON_LEAVE) wifiFail(nowMs);
+    } else if (wifi.state == WifiState::Connected) {
+      wifi.drops++;
+      wifi.state = WifiState::Backoff;
+      wifi.backoffMs = WIFI_BACKOFF_MIN_MS;
+      wifi.dueMs = nowMs;   // first retry at once, on the cached AP
+      logf("WiFi: link lost (reason %u)\n", link.reason);
     }
-    delay(250);
-    Serial.print(".");
+    return;
   }
-  Serial.println("\nSTA connect timed out.");
-  return false;
+
+  bool first = false;
+  {
+    StateLock lock;
+    wifi.state = WifiState::Connected;
+    wifi.dueMs = nowMs + WIFI_IDLE_POLL_MS;
+    wifi.backoffMs = WIFI_BACKOFF_MIN_MS;
+    wifi.hintOk = true;
+    wifi.lastAssocMs = nowMs - wifi.attemptMs;
+    first = (wifi.connects++ == 0);
+    if (!boot.staUpMs) boot.staUpMs = nowMs;
+    memcpy(staBssid, link.bssid, sizeof(staBssid));
+    staChannel = link.channel;
+  }
+  logf("WiFi: connected %s, ch %u, %lu ms%s\n", hal::wifiStaIp(), link.channel,
+       (unsigned long)wifi.lastAssocMs, wifi.hinted ? " (cached AP)" : "");
+  saveSettings();   // writes only if the AP or channel changed
+  ntpKick();
+  if (first) startScan();
 }
 
 void startApModeCaptivePortal() {
-  WiFi.mode(WIFI_AP_STA);
   const char* apSsid = "TechMinds-ESP32WSPR";
   const char* apPass = ""; // open AP
 
-  bool ok = WiFi.softAP(apSsid, apPass);
-  Serial.printf("AP %s: %s\n", ok ? "started" : "FAILED", apSsid);
-  Serial.printf("AP IP: %s\n", WiFi.softAPIP().toString().c_str());
+  bool ok = hal::wifiStartAp(apSsid, apPass);
+  logf("AP %s: %s\n", ok ? "started" : "FAILED", apSsid);
+  logf("AP IP: %s\n", hal::wifiApIp());
 
-  dnsServer.start(DNS_PORT, "*", WiFi.softAPIP());
+  hal::dnsStart();
   captivePortalActive = true;
   Serial.println("Captive portal DNS started");
+  startScan();   // warm the cache for the first page load
+}
+
+// ---------- NTP ----------
+// Time sync never blocks the beacon: ntpService() starts a background SNTP
+// exchange when one is due, and its completion comes back through the
+// command queue (CmdType::NtpDone) into ntpOnResult(). Failures back off
+// exponentially; a good sync is repeated every NTP_RESYNC_MS.
+static const uint32_t NTP_RESYNC_MS = 3600000UL;
+static const uint32_t NTP_BACKOFF_MIN_MS = 5000;
+static const uint32_t NTP_BACKOFF_MAX_MS = 300000UL;
+static const uint32_t NTP_LOST_MS = 15000;   // completion never arrived
+// A step bigger than this during a slot wait restarts the wait.
+static const int64_t NTP_STEP_RESCHEDULE_US = 20000;
+
+enum class NtpState : uint8_t { Idle, Pending, Synced, Backoff };
+
+struct NtpStatus {
+  NtpState state;
+  uint32_t dueMs;         // next request (Idle/Synced/Backoff) or give-up (Pending)
+  uint32_t backoffMs;
+  uint32_t lastSyncEpoch;
+  int64_t lastOffsetUs;
+  uint32_t lastRttUs;
+  uint32_t syncs;
+  uint32_t failures;
+};
+static NtpStatus ntp = { NtpState::Idle, 0, NTP_BACKOFF_MIN_MS, 0, 0, 0, 0, 0 };
+
+static void onNtpDone(const hal::NtpResult& r);   // network task -> queue
+
+static const char* ntpStateName(NtpState s) {
+  switch (s) {
+    case NtpState::Pending: return "pending";
+    case NtpState::Synced:  return "synced";
+    case NtpState::Backoff: return "backoff";
+    default:                return "idle";
+  }
+}
+
+// Sync as soon as possible (link up, server changed, user request).
+void ntpKick() {
+  StateLock lock;
+  if (ntp.state == NtpState::Pending) return;
+  ntp.backoffMs = NTP_BACKOFF_MIN_MS;
+  ntp.dueMs = hal::monoMs();
+}
+
+// Caller holds the state lock.
+static void ntpFail(uint32_t nowMs) {
+  ntp.failures++;
+  ntp.state = NtpState::Backoff;
+  ntp.dueMs = nowMs + ntp.backoffMs;
+  logf("NTP: failed, retry in %lu s\n", (unsigned long)(ntp.backoffMs / 1000));
+  ntp.backoffMs = min(ntp.backoffMs * 2, NTP_BACKOFF_MAX_MS);
+}
+
+// Runs on every beacon wakeup; cheap when nothing is due.
+void ntpService() {
+  uint32_t nowMs = hal::monoMs();
+  if ((int32_t)(nowMs - ntp.dueMs) < 0) return;
+
+  StateLock lock;
+  if (ntp.state == NtpState::Pending) {
+    ntpFail(nowMs);
+    return;
+  }
+  if (!hal::wifiStaConnected()) {
+    ntp.dueMs = nowMs + NTP_BACKOFF_MIN_MS;   // look again when the link is up
+    return;
+  }
+  if (!hal::ntpRequest(ntpServer, onNtpDone)) {
+    ntpFail(nowMs);
+    return;
+  }
+  ntp.state = NtpState::Pending;
+  ntp.dueMs = nowMs + NTP_LOST_MS;
 }
 
-bool syncNtpTime(uint32_t timeoutMs = 20000) {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("NTP: no STA connection; cannot sync time yet.");
+// Milliseconds until ntpService() has something to do.
+static uint32_t ntpDueInMs() {
+  int32_t d = (int32_t)(ntp.dueMs - hal::monoMs());
+  return d > 0 ? (uint32_t)d : 0;
+}
+
+// Returns true if the clock was stepped enough to invalidate a slot wait.
+static bool ntpOnResult(const hal::NtpResult& r) {
+  uint32_t nowMs = hal::monoMs();
+  if (ntp.state != NtpState::Pending) return false;   // gave up on it already
+  if (!r.ok) {
+    StateLock lock;
+    ntpFail(nowMs);
     return false;
   }
+  {
+    StateLock lock;
+    ntp.state = NtpState::Synced;
+    ntp.dueMs = nowMs + NTP_RESYNC_MS;
+    ntp.backoffMs = NTP_BACKOFF_MIN_MS;
+    ntp.lastSyncEpoch = (uint32_t)hal::wallTime();
+    ntp.lastOffsetUs = r.offsetUs;
+    ntp.lastRttUs = r.rttUs;
+    ntp.syncs++;
+    if (!boot.timeValidMs) boot.timeValidMs = nowMs;
+  }
+  logf("NTP: synced via %s, offset %lld us, rtt %lu us\n", ntpServer,
+       (long long)r.offsetUs, (unsigned long)r.rttUs);
+  return r.offsetUs > NTP_STEP_RESCHEDULE_US || r.offsetUs < -NTP_STEP_RESCHEDULE_US;
+}
 
-  configTime(0, 0, ntpServer.c_str());
+// ---------- DAY PLAN ----------
+// The UTC day is 720 two-minute slots. dayPlan holds one nibble per slot
+// (band index or SLOT_OFF), so "what goes out in this slot" is a shift and
+// a mask. slotRank[] counts the planned slots before each slot and
+// rankSlot[] inverts it, so the first planned slot at or after any slot is
+// O(1) as well. All are rebuilt by rebuildDayPlan() whenever the schedule
+// settings change.
+//
+// Coordinated hopping follows the WSJT-X rotation: minute-of-hour mod 20,
+// in two-minute steps, walks 160m..10m (BANDS[0..9]); hopMask picks bands.
+static const uint16_t SLOTS_PER_DAY = 720;
+static const uint32_t SLOT_SEC = 120;
+static const uint8_t SLOT_OFF = 0x0F;
+static const uint8_t HOP_BANDS = 10;
+
+static uint8_t dayPlan[SLOTS_PER_DAY / 2];
+static uint16_t slotRank[SLOTS_PER_DAY];
+static uint16_t rankSlot[SLOTS_PER_DAY];   // first activeSlots entries used
+static uint16_t activeSlots = 0;           // planned slots per day
+static uint32_t txSeed = 0;                // Tx% slot picks, from the callsign
+static_assert(sizeof(SettingsBlob::plan) == SLOTS_PER_DAY + 1, "blob plan size");
+
+static inline uint8_t slotBand(uint16_t slot) {
+  uint8_t b = dayPlan[slot >> 1];
+  return (slot & 1) ? (b >> 4) : (b & 0x0F);
+}
 
-  Serial.printf("NTP: syncing via %s", ntpServer.c_str());
-  uint32_t start = millis();
-  time_t now = 0;
-  while (millis() - start < timeoutMs) {
-    time(&now);
-    if (now > 1000000000) {
-      Serial.println(" ok");
-      return true;
-    }
-    Serial.print(".");
-    delay(300);
+static inline void setSlotBand(uint16_t slot, uint8_t band) {
+  uint8_t& b = dayPlan[slot >> 1];
+  b = (slot & 1) ? (uint8_t)((b & 0x0F) | (band << 4)) : (uint8_t)((b & 0xF0) | band);
+}
+
+static inline uint16_t slotOfDay(time_t t) {
+  return (uint16_t)((t % 86400) / SLOT_SEC);
+}
+
+// Custom plan character -> band index, SLOT_OFF, or 0xFF if invalid.
+static uint8_t planCharBand(char c) {
+  if (c == '-') return SLOT_OFF;
+  uint8_t b = (c >= '0' && c <= '9') ? (uint8_t)(c - '0')
+            : (c >= 'a' && c <= 'f') ? (uint8_t)(c - 'a' + 10) : 0xFF;
+  return b < NUM_BANDS ? b : 0xFF;
+}
+
+// Bands in the hop rotation: at least one, none past the hop bands.
+static bool isValidHopMask(long mask) {
+  return mask > 0 && mask < (1L << HOP_BANDS);
+}
+
+static bool isValidPlan(const char* plan) {
+  if (strlen(plan) != SLOTS_PER_DAY) return false;
+  for (size_t i = 0; i < SLOTS_PER_DAY; i++) {
+    if (planCharBand(plan[i]) == 0xFF) return false;
   }
-  Serial.println(" failed");
-  return false;
+  return true;
 }
 
-// ---------- TX slot schedule ----------
-time_t computeNextTxEpoch(time_t now) {
-  time_t t = ((now / 120) + 1) * 120;  // next WSPR slot
-
-  if (!txEverySlot) {
-    while (true) {
-      int minute = (t / 60) % 60;
-      int slotIndex = (minute / 2);   // 0,1,2,...
-      if ((slotIndex % 2) == 0) break;
-      t += 120;
+static const char* schedModeName(SchedMode m) {
+  switch (m) {
+    case SchedMode::Hop:    return "hop";
+    case SchedMode::Custom: return "custom";
+    default:                return "single";
+  }
+}
+
+// Caller holds the state lock (the web task reads these tables).
+void rebuildDayPlan() {
+  for (uint16_t s = 0; s < SLOTS_PER_DAY; s++) {
+    uint8_t band = SLOT_OFF;
+    switch (schedMode) {
+      case SchedMode::Single:
+        // Legacy behaviour: every slot, or the even slots of each hour.
+        if (txEverySlot || (s % 2) == 0) band = (uint8_t)bandIndex;
+        break;
+      case SchedMode::Hop: {
+        uint8_t hop = (s % HOP_BANDS);
+        // "Alternate" keeps whole rotations so every band still gets a turn.
+        bool cycleOn = txEverySlot || ((s / HOP_BANDS) % 2) == 0;
+        if (cycleOn && (hopMask & (1u << hop))) band = hop;
+        break;
+      }
+      case SchedMode::Custom:
+        if (strlen(customPlan) == SLOTS_PER_DAY) band = planCharBand(customPlan[s]);
+        break;
     }
+    setSlotBand(s, band);
+  }
+
+  activeSlots = 0;
+  for (uint16_t s = 0; s < SLOTS_PER_DAY; s++) {
+    slotRank[s] = activeSlots;
+    if (slotBand(s) != SLOT_OFF) rankSlot[activeSlots++] = s;
   }
-  return t;
+
+  // FNV-1a: the same callsign always picks the same slots.
+  txSeed = 2166136261UL;
+  for (size_t i = 0; CALLSIGN[i]; i++) txSeed = (txSeed ^ (uint8_t)CALLSIGN[i]) * 16777619UL;
 }
 
-// ---------- WEB UI ----------
-static String pageHtml() {
-  // Embedded HTML; location panel removed; GPS removed.
-  String html =
-R"HTML(<!doctype html>
-<html>
-<head>
-<meta charset="utf-8"/>
-<meta name="viewport" content="width=device-width, initial-scale=1"/>
-<title>Tech Minds ESP32WSPR</title>
-<style>
-  :root{
-    --bg:#0b1220; --panel:#101a2e; --panel2:#0f172a;
-    --txt:#e5e7eb; --muted:#94a3b8; --acc:#38bdf8; --good:#34d399; --bad:#fb7185;
-    --br:#22304a;
-  }
-  body{ margin:0; font-family:system-ui,-apple-system,Segoe UI,Roboto,Ubuntu,Arial; background:var(--bg); color:var(--txt); }
-  header{ padding:16px 18px; border-bottom:1px solid var(--br); background:linear-gradient(180deg,var(--panel),#0b1220); }
-  h1{ margin:0; font-size:18px; letter-spacing:.2px; }
-  .sub{ color:var(--muted); font-size:13px; margin-top:6px; }
-  .wrap{ max-width:1020px; margin:0 auto; padding:16px; }
-  .grid{ display:grid; grid-template-columns:1fr; gap:14px; }
-  @media(min-width:900px){ .grid{ grid-template-columns:1fr 1fr; } }
-  .card{ background:var(--panel2); border:1px solid var(--br); border-radius:14px; padding:14px; box-shadow:0 8px 20px rgba(0,0,0,.25); }
-  .card h2{ margin:0 0 10px 0; font-size:15px; color:#dbeafe; }
-  label{ display:block; font-size:12px; color:var(--muted); margin:10px 0 6px; }
-  input,select{
-    width:100%; box-sizing:border-box; padding:10px 10px; border-radius:10px;
-    border:1px solid var(--br); background:#0b1430; color:var(--txt); outline:none;
-  }
-  input:focus,select:focus{ border-color:rgba(56,189,248,.55); box-shadow:0 0 0 3px rgba(56,189,248,.12); }
-  .row{ display:grid; grid-template-columns:1fr 1fr; gap:10px; }
-  button{
-    padding:10px 12px; border-radius:12px; border:1px solid rgba(56,189,248,.35);
-    background:rgba(56,189,248,.12); color:var(--txt); cursor:pointer; font-weight:700;
-  }
-  button:hover{ background:rgba(56,189,248,.18); }
-  .btnline{ display:flex; gap:10px; align-items:center; flex-wrap:wrap; margin-top:12px; }
-  .pill{ padding:6px 10px; border-radius:999px; background:#0b1430; border:1px solid var(--br); color:var(--muted); font-size:12px; }
-  .ok{ color:var(--good); } .no{ color:var(--bad); }
-  pre{ background:#07102a; border:1px solid var(--br); padding:10px; border-radius:12px; overflow:auto; }
-  small{ color:var(--muted); }
-
-  /* toggle */
-  .tog { display:flex; align-items:center; justify-content:space-between; gap:10px; padding:10px; border:1px solid var(--br); border-radius:12px; background:#0b1430; }
-  .switch { position:relative; width:52px; height:28px; }
-  .switch input { display:none; }
-  .slider{
-    position:absolute; inset:0; background:#172554; border:1px solid rgba(56,189,248,.25);
-    border-radius:999px; transition:.2s;
-  }
-  .slider:before{
-    content:""; position:absolute; height:22px; width:22px; left:3px; top:2px;
-    background:#e5e7eb; border-radius:50%; transition:.2s;
-  }
-  .switch input:checked + .slider{ background:rgba(52,211,153,.18); border-color:rgba(52,211,153,.35); }
-  .switch input:checked + .slider:before{ transform:translateX(24px); }
-
-  .topbar{ margin-top:12px; display:grid; grid-template-columns:1fr; gap:10px; }
-  @media(min-width:900px){ .topbar{ grid-template-columns:1fr 1fr; } }
-  .topitem{ background:#0b1430; border:1px solid var(--br); border-radius:14px; padding:10px; }
-  .topitem .k{ color:var(--muted); font-size:12px; }
-  .topitem .v{ font-size:14px; margin-top:4px; }
-  .big{ font-size:16px; font-weight:800; }
-
-  /* Band panel */
-  .bandTable{ width:100%; border-collapse:separate; border-spacing:0 8px; }
-  .bandRow{ background:#0b1430; border:1px solid var(--br); border-radius:12px; }
-  .bandRow td{ padding:10px; vertical-align:middle; }
-  .bandRow td:first-child{ width:52px; text-align:center; }
-  .bandRow td:nth-child(2){ width:70px; font-weight:800; }
-  .bandRow td:nth-child(3){ color:var(--muted); }
-  .bandRow td:nth-child(4){ width:160px; }
-  .bandActive{ outline:2px solid rgba(56,189,248,.35); box-shadow:0 0 0 3px rgba(56,189,248,.08); }
-  .radio{ width:18px; height:18px; accent-color: #38bdf8; }
-  .calInput{ width:100%; }
-  details summary{
-    cursor:pointer; user-select:none; font-weight:800; color:#dbeafe; list-style:none;
-  }
-  details summary::-webkit-details-marker{ display:none; }
-  .summaryLine{
-    display:flex; align-items:center; justify-content:space-between;
-    gap:10px; padding:10px 12px; border:1px solid var(--br);
-    border-radius:12px; background:#0b1430;
-  }
-  .chev{ color:var(--muted); font-weight:800; }
-</style>
-</head>
-<body>
-<header>
-  <h1>Tech Minds ESP32WSPR</h1>
-  <div class="sub">Configure Wi-Fi + WSPR settings • Hostname: <b>)HTML" + String(HOSTNAME) + R"HTML(.local</b></div>
-
-  <div class="topbar">
-    <div class="topitem">
-      <div class="k">Time</div>
-      <div class="v big" id="timeUtc">UTC: —</div>
-      <div class="v"><small id="timeSrc">Source: NTP</small></div>
-    </div>
-    <div class="topitem">
-      <div class="k">Next transmit</div>
-      <div class="v big" id="countdown">—</div>
-      <div class="v"><small id="txState">—</small></div>
-    </div>
-  </div>
-</header>
-
-<div class="wrap">
-  <div class="grid">
-    <div class="card">
-      <h2>Wi-Fi</h2>
-
-      <div class="btnline">
-        <button type="button" onclick="scan()">Scan Networks</button>
-        <span class="pill" id="wifiState">Loading…</span>
-      </div>
-
-      <label>SSID</label>
-      <select id="ssidSel"></select>
-
-      <label>Password</label>
-      <input id="pass" type="password" placeholder="(leave blank if open)"/>
-
-      <div class="btnline">
-        <button type="button" onclick="saveWifi()">Save Wi-Fi</button>
-        <small>Reboot after changing Wi-Fi.</small>
-      </div>
-
-      <label>NTP server</label>
-      <input id="ntp" placeholder="pool.ntp.org" />
-
-      <div class="btnline">
-        <button type="button" onclick="saveNtp()">Save NTP</button>
-        <button type="button" onclick="syncTime()">Sync Time Now</button>
-      </div>
-    </div>
-
-    <div class="card">
-      <h2>WSPR Settings</h2>
-
-      <div class="row">
-        <div>
-          <label>Callsign</label>
-          <input id="call" maxlength="6"/>
-        </div>
-        <div>
-          <label>Locator</label>
-          <input id="loc" maxlength="4"/>
-        </div>
-      </div>
-
-      <div class="row">
-        <div>
-          <label>Power (dBm)</label>
-          <input id="pwr" type="number" min="0" max="60" />
-        </div>
-        <div>
-          <label>&nbsp;</label>
-          <div class="pill">Per-band calibration below</div>
-        </div>
-      </div>
-
-      <label>Bands & per-band calibration (Hz)</label>
-      <div id="bandPanel">Loading bands…</div>
-
-      <label>Transmit control</label>
-      <div class="tog">
-        <div>
-          <div class="big">TX Enabled</div>
-          <small>OFF by default for safety</small>
-        </div>
-        <label class="switch">
-          <input id="txen" type="checkbox"/>
-          <span class="slider"></span>
-        </label>
-      </div>
-
-      <div class="tog" style="margin-top:10px;">
-        <div>
-          <div class="big">TX Every Slot</div>
-          <small>OFF = alternate slots (every 4 minutes)</small>
-        </div>
-        <label class="switch">
-          <input id="txall" type="checkbox"/>
-          <span class="slider"></span>
-        </label>
-      </div>
-
-      <div class="btnline">
-        <button type="button" onclick="saveWspr()">Save WSPR</button>
-      </div>
-    </div>
-
-    <div class="card" style="grid-column:1/-1;">
-      <details id="statusDetails">
-        <summary>
-          <div class="summaryLine">
-            <span>Status (advanced)</span>
-            <span class="chev" id="statusChev">▶</span>
-          </div>
-        </summary>
-        <div style="margin-top:10px;">
-          <pre id="status">Loading…</pre>
-          <div class="btnline">
-            <button type="button" onclick="refresh(true)">Refresh</button>
-            <button type="button" onclick="reboot()">Reboot</button>
-          </div>
-        </div>
-      </details>
-    </div>
-
-  </div>
-</div>
-
-<script>
-let last = null;
-
-// Smooth time: server epoch + (now - fetch_ms)
-let serverEpochAtFetch = 0;
-let fetchMs = 0;
-
-// avoid overwriting the form every refresh
-let formLocked = false;
-
-function fmt2(n){ return String(n).padStart(2,'0'); }
-function fmtHMS(sec){
-  if(sec < 0) sec = 0;
-  const m = Math.floor(sec/60), s = Math.floor(sec%60);
-  return `${fmt2(m)}:${fmt2(s)}`;
-}
-function fmtTimeUTC(epoch){
-  const d = new Date(epoch*1000);
-  return `${fmt2(d.getUTCHours())}:${fmt2(d.getUTCMinutes())}:${fmt2(d.getUTCSeconds())}`;
-}
-function currentUtcEpoch(){
-  if(!last || !last.time_valid) return 0;
-  const dt = (Date.now() - fetchMs) / 1000.0;
-  return Math.floor(serverEpochAtFetch + dt);
-}
-
-function wireFormLock(){
-  const ids = ['call','loc','pwr','txen','txall','ntp'];
-  ids.forEach(id=>{
-    const el = document.getElementById(id);
-    el.addEventListener('input', ()=>{ formLocked = true; });
-    el.addEventListener('change', ()=>{ formLocked = true; });
-  });
-}
-function updateStatusChevron(){
-  const d = document.getElementById('statusDetails');
-  const c = document.getElementById('statusChev');
-  c.textContent = d.open ? '▼' : '▶';
-}
-document.getElementById('statusDetails').addEventListener('toggle', updateStatusChevron);
-
-function buildBandPanel(){
-  const host = document.getElementById('bandPanel');
-  if(!last || !last.bands) { host.textContent = 'No band data.'; return; }
-
-  const tbl = document.createElement('table');
-  tbl.className = 'bandTable';
-
-  last.bands.forEach((b, idx)=>{
-    const tr = document.createElement('tr');
-    tr.className = 'bandRow' + (b.active ? ' bandActive' : '');
-
-    const tdRadio = document.createElement('td');
-    const radio = document.createElement('input');
-    radio.type = 'radio';
-    radio.name = 'activeBand';
-    radio.className = 'radio';
-    radio.value = String(idx);
-    radio.checked = !!b.active;
-    radio.addEventListener('change', ()=>{
-      formLocked = true;
-      [...tbl.querySelectorAll('.bandRow')].forEach(r=>r.classList.remove('bandActive'));
-      tr.classList.add('bandActive');
-    });
-    tdRadio.appendChild(radio);
-
-    const tdName = document.createElement('td');
-    tdName.textContent = b.name;
-
-    const tdFreq = document.createElement('td');
-    tdFreq.textContent = `${(b.dial_hz/1e6).toFixed(6)} MHz (dial)`;
-
-    const tdCal = document.createElement('td');
-    const cal = document.createElement('input');
-    cal.type = 'number';
-    cal.step = '0.1';
-    cal.className = 'calInput';
-    cal.id = `cal_${idx}`;
-    cal.value = (b.cal_hz ?? 0);
-    cal.addEventListener('input', ()=>{ formLocked = true; });
-    tdCal.appendChild(cal);
-
-    tr.appendChild(tdRadio);
-    tr.appendChild(tdName);
-    tr.appendChild(tdFreq);
-    tr.appendChild(tdCal);
-    tbl.appendChild(tr);
-  });
-
-  host.innerHTML = '';
-  host.appendChild(tbl);
-}
-
-function fillFormOnce(){
-  if(formLocked) return;
-  document.getElementById('call').value = last.call || '';
-  document.getElementById('loc').value = last.loc || '';
-  document.getElementById('pwr').value = last.pwr_dbm ?? 10;
-  document.getElementById('txen').checked = !!last.tx_enabled;
-  document.getElementById('txall').checked = !!last.tx_every_slot;
-  document.getElementById('ntp').value = last.ntp_server || 'pool.ntp.org';
-  buildBandPanel();
-}
-
-function updateTopPanel(){
-  if(!last) return;
-
-  if(last.time_valid){
-    const now = currentUtcEpoch();
-    document.getElementById('timeUtc').textContent = `UTC: ${fmtTimeUTC(now)}`;
-  } else {
-    document.getElementById('timeUtc').textContent = `UTC: (waiting for time)`;
+// ---------- TX slot schedule ----------
+// Planned slots are numbered across days, g = day * activeSlots + rank. At
+// a Tx% below 100 that sequence is cut into windows of about 100 / txPct
+// planned slots (window k starts at floor(k * 100 / txPct)) and one slot
+// per window, picked by hashing (txSeed, k), is keyed. The share is exact,
+// gaps are bounded, beacons with different callsigns do not fall into
+// lockstep, and the next keyed slot is closed form: the pick of the window
+// holding the first planned slot, or else the pick of the window after it.
+static uint32_t mix32(uint32_t x) {
+  x ^= x >> 16; x *= 0x7FEB352DUL;
+  x ^= x >> 15; x *= 0x846CA68BUL;
+  return x ^ (x >> 16);
+}
+
+static int64_t txWindowStart(int64_t k) {
+  return k * 100 / txPct;
+}
+
+static int64_t txWindowPick(int64_t k) {
+  int64_t start = txWindowStart(k);
+  uint32_t len = (uint32_t)(txWindowStart(k + 1) - start);
+  return start + mix32(txSeed ^ mix32((uint32_t)k)) % len;
+}
+
+// Next keyed slot start strictly after `now` (0 if the plan is empty);
+// its band goes to *band.
+time_t computeNextTxEpoch(time_t now, uint8_t* band = nullptr) {
+  if (!activeSlots) return 0;
+  time_t t = ((now / SLOT_SEC) + 1) * SLOT_SEC;  // next WSPR slot
+  int64_t g = (int64_t)(t / 86400) * activeSlots + slotRank[slotOfDay(t)];
+  if (txPct < 100) {
+    int64_t k = ((g + 1) * txPct - 1) / 100;     // window holding g
+    int64_t pick = txWindowPick(k);
+    g = pick >= g ? pick : txWindowPick(k + 1);
   }
+  uint16_t s = rankSlot[g % activeSlots];
+  if (band) *band = slotBand(s);
+  return (time_t)(g / activeSlots) * 86400 + (time_t)s * SLOT_SEC;
+}
+
+// ---------- METRICS ----------
+// Counters behind /metrics. Each field has exactly one writing task (noted
+// per group), so an update is a plain aligned 32-bit store with no lock,
+// cheap enough for the symbol path; /metrics may read a value one update
+// old but never a torn one. Sums are 32-bit microseconds and wrap, which a
+// scraper takes for a counter reset.
+enum Endpoint : uint8_t {
+  EP_ROOT, EP_STATUS, EP_METRICS, EP_SCAN, EP_BANDS, EP_SCHEDULE, EP_TIMING,
+  EP_HISTORY, EP_SAVE_WIFI, EP_SAVE_NTP, EP_SAVE_WSPR, EP_SAVE_SCHEDULE,
+  EP_CONFIG, EP_SYNC_TIME, EP_REBOOT, EP_FAVICON, EP_OTHER, EP_COUNT
+};
+static const char* const ENDPOINT_PATHS[EP_COUNT] = {
+  "/", "/status", "/metrics", "/scan", "/bands", "/schedule", "/timing",
+  "/history", "/save_wifi", "/save_ntp", "/save_wspr", "/save_schedule",
+  "/config", "/sync_time", "/reboot", "/favicon.ico", "other",
+};
+static const uint8_t FRAME_OUTCOMES = 4;   // HistAbort values
+
+struct Metrics {
+  // beacon task
+  volatile uint32_t frames[FRAME_OUTCOMES];   // by HistAbort; None = sent
+  volatile uint32_t commands;
+  volatile uint32_t cmdLatencyUs, cmdLatencyMaxUs;   // queued -> applied
+  volatile uint32_t cmdServiceUs, cmdServiceMaxUs;   // applyCommand()
+  volatile uint32_t wakes;                           // timed waits run out
+  volatile uint32_t wakeLateUs, wakeLateMaxUs;       // past the deadline
+  // symbol engine
+  volatile uint32_t i2cWrites;
+  volatile uint32_t i2cErrors;
+  // web task
+  volatile uint32_t httpRequests[EP_COUNT];
+  volatile uint32_t httpUs[EP_COUNT];
+  volatile uint32_t httpMaxUs[EP_COUNT];
+};
+static Metrics metrics = {};
 
-  document.getElementById('timeSrc').textContent = `Source: NTP (${last.ntp_server || 'pool.ntp.org'})`;
+static inline void metricBump(volatile uint32_t& n) {
+  n = n + 1;
 }
 
-function tickCountdown(){
-  if(!last) return;
+static inline void metricObserve(volatile uint32_t& sum, volatile uint32_t& maxUs, int64_t us) {
+  uint32_t v = us <= 0 ? 0 : us >= (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+  sum = sum + v;
+  if (v > maxUs) maxUs = v;
+}
 
-  const txState = document.getElementById('txState');
-  const cd = document.getElementById('countdown');
+// ---------- TIMING TELEMETRY ----------
+// The symbol engine stamps every transition (edge target, setTone() entry,
+// I2C completion) into symTrace[]; after the frame it is reduced to a
+// FrameTiming record. The last TIMING_FRAMES records are served at /timing.
+static const uint8_t TIMING_FRAMES = 8;
+static const uint8_t TIMING_BUCKETS = 10;
+// Upper bound (exclusive) of each edge-error bucket in us; the last bucket
+// takes everything above.
+static const int32_t TIMING_BUCKET_US[TIMING_BUCKETS - 1] = {
+  10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
 
-  if(!last.tx_enabled){
-    cd.textContent = 'TX DISABLED';
-    txState.textContent = last.tx_every_slot ? 'Every slot' : 'Alternate slots';
-    return;
+struct SymbolStamp {
+  int32_t targetUs;   // all relative to the frame's symbol 0 edge
+  int32_t enterUs;
+  int32_t doneUs;
+};
+static SymbolStamp symTrace[WSPR_SYMBOL_COUNT];
+
+struct FrameTiming {
+  uint32_t startEpoch;
+  uint8_t band;
+  int32_t startErrUs;                                   // symbol 0 vs UTC frame start
+  int32_t edgeMinUs, edgeMaxUs, edgeP50Us, edgeP99Us;   // enter - target
+  int32_t writeMaxUs;                                   // done - enter
+  uint32_t i2cBytes;
+  uint16_t hist[TIMING_BUCKETS];
+};
+static FrameTiming timingLog[TIMING_FRAMES];
+static uint8_t timingHead = 0;    // next slot to write
+static uint8_t timingCount = 0;
+
+static uint8_t timingBucket(int32_t errUs) {
+  uint8_t b = 0;
+  while (b < TIMING_BUCKETS - 1 && errUs >= TIMING_BUCKET_US[b]) b++;
+  return b;
+}
+
+const FrameTiming& recordFrameTiming(uint32_t startEpoch, uint8_t band, uint32_t i2cBytes,
+                                     int64_t startErrUs) {
+  FrameTiming f;
+  memset(&f, 0, sizeof(f));
+  f.startEpoch = startEpoch;
+  f.startErrUs = (int32_t)max((int64_t)INT32_MIN, min((int64_t)INT32_MAX, startErrUs));
+  f.band = band;
+  f.i2cBytes = i2cBytes;
+
+  int32_t err[WSPR_SYMBOL_COUNT];
+  for (int i = 0; i < WSPR_SYMBOL_COUNT; i++) {
+    const SymbolStamp& st = symTrace[i];
+    err[i] = st.enterUs - st.targetUs;
+    int32_t w = st.doneUs - st.enterUs;
+    if (w > f.writeMaxUs) f.writeMaxUs = w;
+    f.hist[timingBucket(err[i])]++;
   }
-  if(!last.time_valid){
-    cd.textContent = 'WAITING FOR TIME';
-    txState.textContent = 'TX will start once time is valid';
+  std::sort(err, err + WSPR_SYMBOL_COUNT);
+  f.edgeMinUs = err[0];
+  f.edgeMaxUs = err[WSPR_SYMBOL_COUNT - 1];
+  f.edgeP50Us = err[WSPR_SYMBOL_COUNT / 2];
+  f.edgeP99Us = err[(WSPR_SYMBOL_COUNT * 99 + 99) / 100 - 1];
+
+  hal::stateLock();
+  FrameTiming& slot = timingLog[timingHead];
+  slot = f;
+  timingHead = (timingHead + 1) % TIMING_FRAMES;
+  if (timingCount < TIMING_FRAMES) timingCount++;
+  hal::stateUnlock();
+  return slot;
+}
+
+// ---------- TX HISTORY ----------
+// Every frame the beacon sets out to key leaves one fixed-size record; with
+// TX off, only the first slot it skips does. A ring in PSRAM holds the
+// recent ones; they reach a LittleFS log in batches (HIST_FLUSH_FRAMES or
+// HIST_FLUSH_MS, whichever comes first) to spare the flash. At HIST_FILE_MAX the log becomes the one older generation, so the
+// two files hold ~2 months at one frame every slot. Records carry a running
+// sequence number that survives reboots; /history pages by it.
+enum class HistAbort : uint8_t { None, TxDisabled, TimeInvalid, MissedStart };
+static const char* HIST_ABORT_NAMES[] = { "", "tx_disabled", "time_invalid", "missed_start" };
+static_assert((uint8_t)HistAbort::MissedStart + 1 == FRAME_OUTCOMES, "one metrics slot per outcome");
+
+struct HistoryRecord {
+  uint32_t seq;
+  uint32_t startEpoch;          // UTC second of symbol 0
+  int64_t carrierCentiHz;       // tone 0 incl. cal and scatter; 0: never planned
+  int32_t startErrUs;
+  int32_t edgeP50Us, edgeP99Us, edgeMaxUs;
+  int32_t writeMaxUs;
+  uint16_t i2cBytes;
+  uint16_t symbols;             // symbols keyed
+  int16_t scatterHz;
+  uint8_t band;
+  uint8_t msgType;
+  uint8_t abort;                // HistAbort
+  uint8_t clk;                  // Si5351 output
+  uint8_t reserved[2];
+};
+static_assert(sizeof(HistoryRecord) == 48, "the log and ?format=bin are fixed 48-byte records");
+
+static const uint32_t HIST_RING_RECORDS = 8192;      // 384 KB of PSRAM
+static const uint32_t HIST_RING_FALLBACK = 32;       // internal RAM without PSRAM
+static const uint32_t HIST_FLUSH_FRAMES = 8;
+static const uint32_t HIST_FLUSH_MS = 1800000UL;
+static const size_t HIST_FILE_MAX = 1024UL * 1024;
+static const char* HIST_LOG = "/txlog.bin";
+static const char* HIST_OLD = "/txlog.old";
+
+static HistoryRecord histFallback[HIST_RING_FALLBACK];
+static HistoryRecord* histRing = histFallback;
+static uint32_t histCap = HIST_RING_FALLBACK;
+static uint32_t histNext = 0;        // seq of the next record
+static uint32_t histCount = 0;       // records in the ring: histNext - histCount ..
+static uint32_t histFlushedTo = 0;   // seqs below this are in the log
+static uint32_t histPendingMs = 0;   // when the oldest unflushed record came in
+
+struct HistoryStats {
+  bool fs;                           // log mounted
+  uint32_t flushes;
+  uint32_t flushFailures;
+  uint32_t logBytes;                 // both generations
+};
+static HistoryStats histStats = { false, 0, 0, 0 };
+
+// LittleFS commits an append atomically at close, so a file never ends in
+// a partial record; if one somehow does, start a new generation rather than
+// misalign everything after it.
+void historyBegin() {
+  void* p = hal::psramAlloc(HIST_RING_RECORDS * sizeof(HistoryRecord));
+  if (p) {
+    histRing = (HistoryRecord*)p;
+    histCap = HIST_RING_RECORDS;
+  }
+  histStats.fs = hal::fsBegin();
+  if (!histStats.fs) {
+    Serial.println("History: no file system, keeping the RAM ring only");
     return;
   }
-
-  const now = currentUtcEpoch();
-  const remain = (last.next_tx_epoch || 0) - now;
-  const activeBand = (last.band || '—');
-  txState.textContent = (last.tx_every_slot ? 'Every slot' : 'Alternate slots') + ` • Band ${activeBand}`;
-  cd.textContent = `Next TX in ${fmtHMS(remain)} (at ${fmtTimeUTC(last.next_tx_epoch)} UTC)`;
+  size_t size = hal::fsSize(HIST_LOG);
+  if (size % sizeof(HistoryRecord)) {
+    hal::fsRemove(HIST_OLD);
+    hal::fsRename(HIST_LOG, HIST_OLD);
+  }
+  const char* newestFirst[] = { HIST_LOG, HIST_OLD };
+  for (const char* f : newestFirst) {
+    size_t n = hal::fsSize(f) / sizeof(HistoryRecord);
+    HistoryRecord r;
+    if (n && hal::fsRead(f, (n - 1) * sizeof(r), &r, sizeof(r)) == sizeof(r)) {
+      histNext = r.seq + 1;
+      break;
+    }
+  }
+  histFlushedTo = histNext;
+  histStats.logBytes = (uint32_t)(hal::fsSize(HIST_LOG) + hal::fsSize(HIST_OLD));
+  logf("History: %lu frame(s) logged, %lu-record ring in %s\n",
+       (unsigned long)histNext, (unsigned long)histCap, p ? "PSRAM" : "RAM");
 }
 
-async function refresh(forceFill=false){
-  const r = await fetch('/status');
-  last = await r.json();
+static void historyAdd(HistoryRecord& r) {
+  if (r.clk == 0 && r.abort < FRAME_OUTCOMES) metricBump(metrics.frames[r.abort]);
+  StateLock lock;
+  r.seq = histNext++;
+  histRing[r.seq % histCap] = r;
+  if (histCount < histCap) histCount++;
+  // Log unwritable for a whole ring: the oldest unflushed records are gone.
+  if (histNext - histFlushedTo > histCap) histFlushedTo = histNext - histCap;
+  if (r.seq == histFlushedTo) histPendingMs = hal::monoMs();
+}
 
-  if(last.time_valid){
-    serverEpochAtFetch = last.now_epoch || 0;
-    fetchMs = Date.now();
+// Appends the unflushed records in one write per contiguous ring run.
+// Only the beacon writes the ring, so the records stay put while the flash
+// is written without the lock; it is taken again only to publish progress.
+// /history reads the files without the lock and checks every seq it gets,
+// so a rotation under it costs a short page, never a wrong record.
+static void historyFlush() {
+  if (!histStats.fs) return;
+  uint32_t from, to;
+  {
+    StateLock lock;
+    from = histFlushedTo;
+    to = histNext;
+  }
+  if (from == to) return;
+  bool ok = true;
+  while (from != to) {
+    uint32_t idx = from % histCap;
+    uint32_t n = min(to - from, histCap - idx);
+    if (hal::fsSize(HIST_LOG) >= HIST_FILE_MAX) {
+      hal::fsRemove(HIST_OLD);
+      hal::fsRename(HIST_LOG, HIST_OLD);
+    }
+    if (!hal::fsAppend(HIST_LOG, &histRing[idx], n * sizeof(HistoryRecord))) {
+      ok = false;   // retried on the next flush
+      break;
+    }
+    from += n;
   }
+  uint32_t logBytes = (uint32_t)(hal::fsSize(HIST_LOG) + hal::fsSize(HIST_OLD));
+  StateLock lock;
+  histFlushedTo = from;
+  histStats.logBytes = logBytes;
+  if (ok) histStats.flushes++;
+  else histStats.flushFailures++;
+}
 
-  document.getElementById('status').textContent = JSON.stringify(last, null, 2);
+// Called by the beacon between frames.
+void historyService() {
+  uint32_t pending = histNext - histFlushedTo;
+  if (!pending) return;
+  if (pending >= HIST_FLUSH_FRAMES || hal::monoMs() - histPendingMs >= HIST_FLUSH_MS) {
+    historyFlush();
+  }
+}
 
-  const st = document.getElementById('wifiState');
-  if(last.sta_connected){
-    st.textContent = 'STA: ' + last.sta_ip;
-    st.className = 'pill ok';
-  } else {
-    st.textContent = 'AP mode available';
-    st.className = 'pill no';
+// First seq still available, in the log or the ring. Takes the lock
+// itself, only to read the counters; the files are read without it.
+static uint32_t historyOldest() {
+  uint32_t ringFirst;
+  {
+    StateLock lock;
+    ringFirst = histNext - histCount;
   }
+  const char* oldestFirst[] = { HIST_OLD, HIST_LOG };
+  for (const char* f : oldestFirst) {
+    HistoryRecord r;
+    if (hal::fsRead(f, 0, &r, sizeof(r)) == sizeof(r)) return min(r.seq, ringFirst);
+  }
+  return ringFirst;
+}
 
-  if(forceFill){
-    formLocked = false;
+// Copies up to n records from seq on into out; returns how many (0: seq is
+// not available). Records still in the ring are copied under the lock,
+// older ones are read from the files without it and kept only while their
+// seq runs on from the one asked for.
+static size_t historyRead(uint32_t seq, HistoryRecord* out, size_t n) {
+  {
+    StateLock lock;
+    if (seq >= histNext) return 0;
+    if (seq >= histNext - histCount) {
+      n = min(n, (size_t)(histNext - seq));
+      for (size_t i = 0; i < n; i++) out[i] = histRing[(seq + i) % histCap];
+      return n;
+    }
+  }
+  const char* oldestFirst[] = { HIST_OLD, HIST_LOG };
+  for (const char* f : oldestFirst) {
+    uint32_t count = (uint32_t)(hal::fsSize(f) / sizeof(HistoryRecord));
+    HistoryRecord first;
+    if (!count || hal::fsRead(f, 0, &first, sizeof(first)) != sizeof(first)) continue;
+    if (seq < first.seq || seq - first.seq >= count) continue;
+    n = min(n, (size_t)(first.seq + count - seq));
+    size_t got = hal::fsRead(f, (size_t)(seq - first.seq) * sizeof(HistoryRecord),
+                             out, n * sizeof(HistoryRecord)) / sizeof(HistoryRecord);
+    size_t k = 0;
+    while (k < got && out[k].seq == seq + k) k++;
+    return k;
   }
-  fillFormOnce();
-  updateTopPanel();
-  tickCountdown();
+  return 0;
+}
+
+// ---------- PUSH EVENTS ----------
+// State changes go out on /events (Server-Sent Events) as small JSON deltas
+// shaped like parts of /status, so the page merges them into what it last
+// fetched instead of polling. Only the beacon task publishes; with no
+// client connected nothing is even formatted.
+static char eventStage[64];           // JsonWriter buffer, drains into eventOut
+static char eventOut[hal::EVENTS_DATA_MAX];
+static size_t eventLen = 0;
+static uint32_t eventSeq = 0;         // SSE id of the last event sent
+
+// The frame on air, for /status; transmitWSPR() owns it.
+struct TxNow {
+  volatile bool on;
+  uint8_t outputs;
+  uint8_t bands[TX_OUTPUTS];    // [0] is CLK0, then the extra outputs keyed
+  uint8_t type;
+  uint32_t startEpoch;
+};
+static TxNow txNow = { false, 0, { 0, 0, 0 }, 0, 0 };
+
+static void eventAppend(const char* data, size_t len) {
+  if (eventLen + len < sizeof(eventOut)) memcpy(eventOut + eventLen, data, len);
+  eventLen += len;   // past the end: the event is dropped in publishEvent()
+}
+
+static JsonWriter beginEvent() {
+  eventLen = 0;
+  JsonWriter w(eventStage, sizeof(eventStage), eventAppend);
+  w.beginObject();
+  return w;
 }
 
-async function scan(){
-  const sel = document.getElementById('ssidSel');
-  sel.innerHTML = '<option>Scanning…</option>';
-  const r = await fetch('/scan');
-  const j = await r.json();
-  sel.innerHTML = '';
-  (j.networks || []).forEach(n=>{
-    const o = document.createElement('option');
-    o.value = n.ssid;
-    o.textContent = `${n.ssid}  (${n.rssi} dBm)`;
-    sel.appendChild(o);
-  });
-  if(!sel.options.length){
-    sel.innerHTML = '<option>(no networks found)</option>';
+static void publishEvent(JsonWriter& w, const char* name) {
+  w.endObject();
+  w.finish();
+  if (eventLen >= sizeof(eventOut)) {
+    logf("Event '%s' too long (%u bytes), dropped\n", name, (unsigned)eventLen);
+    return;
   }
+  eventOut[eventLen] = 0;
+  hal::eventsSend(name, eventOut, ++eventSeq);
 }
 
-async function saveWifi(){
-  const ssid = document.getElementById('ssidSel').value || '';
-  const pass = document.getElementById('pass').value || '';
-  const body = new URLSearchParams({ssid, pass});
-  await fetch('/save_wifi', {method:'POST', body});
-  await refresh(true);
-  alert('Saved Wi-Fi. Reboot to try connecting.');
+// Extra output bands (-1: off) and per-output trims, as in /status.
+static void writeOutputs(JsonWriter& w) {
+  w.beginArray("extra_band");
+  for (uint8_t k = 0; k < TX_OUTPUTS - 1; k++) w.value(extraBand[k] == OUT_OFF ? -1 : (int)extraBand[k]);
+  w.endArray();
+  w.beginArray("out_cal_hz");
+  for (uint8_t k = 0; k < TX_OUTPUTS; k++) w.fixedValue(outCalHz[k], 1);
+  w.endArray();
 }
 
-async function saveNtp(){
-  const ntp = document.getElementById('ntp').value || 'pool.ntp.org';
-  const body = new URLSearchParams({ntp});
-  await fetch('/save_ntp', {method:'POST', body});
-  await refresh(true);
-  alert('Saved NTP server.');
+static void pushSettings() {
+  if (!hal::eventsClients()) return;
+  JsonWriter w = beginEvent();
+  w.field("call", CALLSIGN);
+  w.field("loc", LOCATOR);
+  w.field("pwr_dbm", POWER_DBM);
+  w.beginArray("msg_types");
+  for (size_t i = 0; i < msgSeqLen; i++) w.value((int)msgSeq[i]->type);
+  w.endArray();
+  w.field("band", BANDS[bandIndex].name);
+  w.field("band_index", (int)bandIndex);
+  w.field("tx_enabled", txEnabled);
+  w.field("tx_every_slot", txEverySlot);
+  w.field("ntp_server", ntpServer);
+  w.field("sched_mode", schedModeName(schedMode));
+  w.field("tx_pct", txPct);
+  writeOutputs(w);
+  publishEvent(w, "settings");
 }
 
-async function syncTime(){
-  await fetch('/sync_time', {method:'POST'});
-  await refresh(true);
+static void pushTime() {
+  if (!hal::eventsClients()) return;
+  time_t now = hal::wallTime();
+  bool tOk = timeValid();
+  JsonWriter w = beginEvent();
+  w.field("time_valid", tOk);
+  w.field("now_epoch", (uint32_t)(tOk ? now : 0));
+  w.beginObject("ntp");
+  w.field("state", ntpStateName(ntp.state));
+  w.field("last_sync_epoch", ntp.lastSyncEpoch);
+  w.field("offset_us", (long long)ntp.lastOffsetUs);
+  w.field("rtt_us", ntp.lastRttUs);
+  w.field("syncs", ntp.syncs);
+  w.field("failures", ntp.failures);
+  w.endObject();
+  publishEvent(w, "time");
 }
 
-function getActiveBandIndex(){
-  const r = document.querySelector('input[name="activeBand"]:checked');
-  return r ? r.value : null;
+static void pushWifi() {
+  if (!hal::eventsClients()) return;
+  bool sta = hal::wifiStaConnected();
+  JsonWriter w = beginEvent();
+  w.field("sta_connected", sta);
+  w.field("sta_ip", sta ? hal::wifiStaIp() : "");
+  w.beginObject("wifi");
+  w.field("state", wifiStateName(wifi.state));
+  w.field("channel", (unsigned)staChannel);
+  w.field("cached_ap", staHintValid());
+  w.field("connects", wifi.connects);
+  w.field("failures", wifi.failures);
+  w.field("drops", wifi.drops);
+  w.field("last_reason", (unsigned)wifi.lastReason);
+  w.endObject();
+  publishEvent(w, "wifi");
 }
 
-async function saveWspr(){
-  const call = document.getElementById('call').value || '';
-  const loc  = document.getElementById('loc').value || '';
-  const pwr  = document.getElementById('pwr').value || '10';
-  const txen = document.getElementById('txen').checked ? '1' : '0';
-  const txall = document.getElementById('txall').checked ? '1' : '0';
+// nextTx 0: nothing planned.
+static void pushNextSlot(time_t nextTx, uint8_t band) {
+  if (!hal::eventsClients()) return;
+  JsonWriter w = beginEvent();
+  w.field("now_epoch", (uint32_t)hal::wallTime());
+  w.field("next_tx_epoch", (uint32_t)nextTx);
+  w.field("next_tx_band", nextTx ? BANDS[band].name : "");
+  publishEvent(w, "next");
+}
 
-  const band = getActiveBandIndex();
-  if(band === null){
-    alert('Select an active band first.');
-    return;
+static void pushTx(int sent, const int64_t* startErrUs = nullptr) {
+  if (!hal::eventsClients()) return;
+  JsonWriter w = beginEvent();
+  w.beginObject("tx");
+  w.field("on", (bool)txNow.on);
+  w.field("band", BANDS[txNow.bands[0]].name);
+  w.beginArray("bands");
+  for (uint8_t k = 0; k < txNow.outputs; k++) w.value(BANDS[txNow.bands[k]].name);
+  w.endArray();
+  w.field("type", (unsigned)txNow.type);
+  w.field("start_epoch", txNow.startEpoch);
+  w.field("sent", sent);
+  w.field("of", WSPR_SYMBOL_COUNT);
+  if (startErrUs) w.field("start_err_us", (long long)*startErrUs);
+  w.endObject();
+  publishEvent(w, "tx");
+}
+
+// ---------- COMMANDS (web -> beacon) ----------
+// Web handlers run on the network task. They only validate and enqueue;
+// the beacon applies commands between frames, so settings never change
+// under a transmission. Everything the handlers read back is taken under
+// hal::stateLock(), which the beacon also holds while it writes.
+enum class CmdType : uint8_t {
+  SaveWifi, SaveNtp, SaveWspr, SaveSchedule, Config, SyncTime, Reboot, NtpDone, WifiLink
+};
+
+struct Command {
+  CmdType type;
+  int64_t queuedUs;               // hal::monoUs() when sent
+  char ssid[33];
+  char pass[65];
+  uint32_t staIp;            // 0: DHCP
+  uint32_t staGateway;
+  uint32_t staNetmask;
+  uint32_t staDns;
+  char ntp[64];
+  char call[12];
+  char loc[8];
+  uint8_t pwr;
+  uint8_t band;
+  bool txEnabled;
+  bool txEverySlot;
+  bool calSet[NUM_BANDS];
+  double calHz[NUM_BANDS];
+  uint8_t extraBand[TX_OUTPUTS - 1];
+  bool outCalSet[TX_OUTPUTS];
+  double outCalHz[TX_OUTPUTS];
+  hal::NtpResult ntpResult;
+  hal::WifiLink wifiLink;
+  uint8_t schedMode;
+  uint16_t hopMask;
+  uint8_t txPct;
+  char plan[SLOTS_PER_DAY + 1];   // empty: keep the stored custom plan
+};
+
+static const size_t CMD_QUEUE_DEPTH = 6;
+static hal::Queue cmdQueue = nullptr;
+
+// The settings parts of a command; callers hold the state lock. Config
+// carries all four, each filled in completely.
+static bool applyWifi(const Command& c) {
+  bool changed = strcmp(wifiSsid, c.ssid) != 0 || strcmp(wifiPass, c.pass) != 0 ||
+                 staIp != c.staIp || staGateway != c.staGateway ||
+                 staNetmask != c.staNetmask || staDns != c.staDns;
+  if (strcmp(wifiSsid, c.ssid) != 0) staChannel = 0;   // other network: drop the cached AP
+  strlcpy(wifiSsid, c.ssid, sizeof(wifiSsid));
+  strlcpy(wifiPass, c.pass, sizeof(wifiPass));
+  staIp = c.staIp;
+  staGateway = c.staGateway;
+  staNetmask = c.staNetmask;
+  staDns = c.staDns;
+  return changed;
+}
+
+static bool applyNtp(const Command& c) {
+  bool changed = strcmp(ntpServer, c.ntp) != 0;
+  strlcpy(ntpServer, c.ntp, sizeof(ntpServer));
+  return changed;
+}
+
+static void applyWspr(const Command& c) {
+  strlcpy(CALLSIGN, c.call, sizeof(CALLSIGN));
+  strlcpy(LOCATOR, c.loc, sizeof(LOCATOR));
+  POWER_DBM = c.pwr;
+  bandIndex = c.band;
+  txEnabled   = c.txEnabled;
+  txEverySlot = c.txEverySlot;
+  for (size_t i = 0; i < NUM_BANDS; i++) {
+    if (c.calSet[i]) bandCalHz[i] = c.calHz[i];
   }
+  for (uint8_t k = 0; k < TX_OUTPUTS; k++) {
+    if (c.outCalSet[k]) outCalHz[k] = c.outCalHz[k];
+  }
+  memcpy(extraBand, c.extraBand, sizeof(extraBand));
+  framePlans[0].valid = false;
+}
+
+static void applySchedule(const Command& c) {
+  schedMode = (SchedMode)c.schedMode;
+  hopMask = c.hopMask;
+  txPct = c.txPct;
+  if (c.plan[0]) strlcpy(customPlan, c.plan, sizeof(customPlan));
+}
 
-  const body = new URLSearchParams({call, loc, pwr, txen, txall, band});
+// Returns true if the command changed what or when the beacon transmits.
+static bool applyCommand(const Command& c) {
+  switch (c.type) {
+    case CmdType::SaveWifi: {
+      {
+        StateLock lock;
+        applyWifi(c);
+      }
+      wifiKick();
+      break;
+    }
+    case CmdType::SaveNtp: {
+      {
+        StateLock lock;
+        applyNtp(c);
+      }
+      ntpKick();
+      break;
+    }
+    case CmdType::SaveWspr: {
+      {
+        StateLock lock;
+        applyWspr(c);
+        rebuildDayPlan();
+      }
+      rebuildMessages();
+      break;
+    }
+    case CmdType::SaveSchedule: {
+      StateLock lock;
+      applySchedule(c);
+      rebuildDayPlan();
+      break;
+    }
+    case CmdType::Config: {
+      // All of it, then one blob write below. The link and NTP restart
+      // only if their settings actually changed.
+      bool wifiChanged, ntpChanged;
+      {
+        StateLock lock;
+        wifiChanged = applyWifi(c);
+        ntpChanged = applyNtp(c);
+        applyWspr(c);
+        applySchedule(c);
+        rebuildDayPlan();
+      }
+      rebuildMessages();
+      if (wifiChanged) wifiKick();
+      if (ntpChanged) ntpKick();
+      saveSettings();
+      pushWifi();
+      pushSettings();
+      return true;
+    }
+    case CmdType::SyncTime:
+      ntpKick();
+      pushTime();
+      return false;
+    case CmdType::NtpDone: {
+      bool stepped = ntpOnResult(c.ntpResult);
+      pushTime();
+      return stepped;
+    }
+    case CmdType::WifiLink:
+      wifiOnLink(c.wifiLink);
+      pushWifi();
+      return false;
+    case CmdType::Reboot:
+      historyFlush();
+      hal::sleepMs(200);   // let the response drain
+      hal::restart();
+      return false;
+  }
+  saveSettings();
+  if (c.type == CmdType::SaveWifi) pushWifi();
+  else pushSettings();
+  return c.type == CmdType::SaveWspr || c.type == CmdType::SaveSchedule;
+}
 
-  if(last && last.bands){
-    last.bands.forEach((b, idx)=>{
-      const el = document.getElementById(`cal_${idx}`);
-      const v = el ? (el.value || '0') : '0';
-      body.append(`cal_${idx}`, v);
-    });
+// Sleeps on the command queue until waitMs has passed, waking early only
+// for commands and WiFi/NTP deadlines. Returns false early if a command
+// changed the schedule (or stepped the clock) and the slot must be
+// recomputed.
+static bool serviceCommands(uint32_t waitMs) {
+  const int64_t endUs = hal::monoUs() + (int64_t)waitMs * 1000;
+  Command c;
+  for (;;) {
+    wifiService();
+    ntpService();
+    int64_t remainUs = endUs - hal::monoUs();
+    if (remainUs <= 0) {
+      metricBump(metrics.wakes);
+      metricObserve(metrics.wakeLateUs, metrics.wakeLateMaxUs, -remainUs);
+      return true;
+    }
+    uint32_t sliceMs = min((uint32_t)((remainUs + 999) / 1000), min(wifiDueInMs(), ntpDueInMs()));
+    if (!hal::queueReceive(cmdQueue, &c, sliceMs)) continue;
+
+    const int64_t t0 = hal::monoUs();
+    bool replan = applyCommand(c);
+    metricBump(metrics.commands);
+    metricObserve(metrics.cmdLatencyUs, metrics.cmdLatencyMaxUs, t0 - c.queuedUs);
+    metricObserve(metrics.cmdServiceUs, metrics.cmdServiceMaxUs, hal::monoUs() - t0);
+    if (replan) return false;
   }
+}
 
-  await fetch('/save_wspr', {method:'POST', body});
-  formLocked = false;
-  await refresh(true);
-  alert('Saved WSPR settings.');
+static void onNtpDone(const hal::NtpResult& r) {
+  Command c = {};
+  c.type = CmdType::NtpDone;
+  c.queuedUs = hal::monoUs();
+  c.ntpResult = r;
+  hal::queueSend(cmdQueue, &c);   // if full, ntpService() times the attempt out
 }
 
-async function reboot(){
-  await fetch('/reboot', {method:'POST'});
-  alert('Rebooting…');
+static void onWifiLink(const hal::WifiLink& link) {
+  Command c = {};
+  c.type = CmdType::WifiLink;
+  c.queuedUs = hal::monoUs();
+  c.wifiLink = link;
+  hal::queueSend(cmdQueue, &c);   // if full, wifiService() notices the stale state
 }
 
-setInterval(()=>{ updateTopPanel(); tickCountdown(); }, 1000);
-setInterval(()=>refresh(false), 10000);
+static void postCommand(Command& c) {
+  c.queuedUs = hal::monoUs();
+  if (hal::queueSend(cmdQueue, &c)) hal::httpSend(200, "text/plain", "OK");
+  else hal::httpSend(503, "text/plain", "Busy");
+}
 
-(async ()=>{
-  wireFormLock();
-  updateStatusChevron();
-  await refresh(true);
-  await scan();
-})();
-</script>
-</body>
-</html>)HTML";
+// ---------- WEB UI ----------
+// The page lives in web/index.html and is minified + gzipped at build time
+// (scripts/embed_web.py -> web_ui.h), then sent straight from flash.
+static const char* WEB_HEADERS[] = { "If-None-Match" };   // also used by /bands
 
-  return html;
+static void sendWebUi() {
+  hal::httpSendHeader("Content-Encoding", "gzip");
+  hal::httpSendStatic(200, "text/html; charset=utf-8", WEB_UI_GZ, WEB_UI_GZ_LEN);
 }
 
 void handleRoot() {
-  server.send(200, "text/html; charset=utf-8", pageHtml());
+  hal::httpSendHeader("ETag", WEB_UI_ETAG);
+  hal::httpSendHeader("Cache-Control", "no-cache");
+  if (strstr(hal::httpHeader("If-None-Match"), WEB_UI_ETAG)) {
+    hal::httpSend(304);
+    return;
+  }
+  sendWebUi();
 }
 
 void handleCaptivePortal() {
-  server.sendHeader("Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
-  server.sendHeader("Pragma", "no-cache");
-  server.send(200, "text/html; charset=utf-8", pageHtml());
+  hal::httpSendHeader("Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
+  hal::httpSendHeader("Pragma", "no-cache");
+  sendWebUi();
+}
+
+// JSON is formatted through one static buffer into the HAL's fixed response
+// slot and goes out as HTTP chunks, so its size never touches the heap.
+// Handlers run one at a time on the web task.
+static const size_t JSON_CHUNK = 512;
+static char jsonBuf[JSON_CHUNK];
+
+static JsonWriter beginJson() {
+  hal::httpBeginChunked(200, "application/json");
+  return JsonWriter(jsonBuf, sizeof(jsonBuf), hal::httpSendChunk);
+}
+
+static void endJson(JsonWriter& w) {
+  w.finish();
+  hal::httpEndChunked();
+}
+
+// Scratch for the request in flight (trimmed fields, a normalised plan):
+// bump-allocated and reset by metered() once the handler has answered, so
+// parsing a request never touches the heap either.
+static const size_t ARENA_BYTES = 1024;
+static char arenaBuf[ARENA_BYTES];
+static size_t arenaUsed = 0;
+
+static char* arenaAlloc(size_t n) {
+  if (n > ARENA_BYTES - arenaUsed) return nullptr;
+  char* p = arenaBuf + arenaUsed;
+  arenaUsed += n;
+  return p;
+}
+
+// Argument `name` with surrounding blanks cut, upper-cased if asked, in
+// the arena; nullptr if it does not fit.
+static char* argTrimmed(const char* name, bool upper = false) {
+  const char* a = hal::httpArg(name);
+  while (isspace((unsigned char)*a)) a++;
+  size_t n = strlen(a);
+  while (n && isspace((unsigned char)a[n - 1])) n--;
+  char* out = arenaAlloc(n + 1);
+  if (!out) return nullptr;
+  for (size_t i = 0; i < n; i++) out[i] = upper ? (char)toupper((unsigned char)a[i]) : a[i];
+  out[n] = 0;
+  return out;
+}
+
+static bool argIs(const char* name, const char* value) {
+  return strcmp(hal::httpArg(name), value) == 0;
+}
+
+// /bands changes only when a calibration is saved; hash the table into an
+// ETag so polling dashboards revalidate with a 304 instead of re-fetching.
+static void bandsEtag(char out[12]) {
+  uint32_t h = 2166136261UL;   // FNV-1a
+  h = (h ^ WSPR_IARU_REGION) * 16777619UL;   // dials differ per build region
+  for (size_t i = 0; i < NUM_BANDS; i++) {
+    int32_t centiHz = (int32_t)lround(bandCalHz[i] * 100.0);
+    for (uint8_t k = 0; k < 4; k++) {
+      h = (h ^ (uint8_t)(centiHz >> (8 * k))) * 16777619UL;
+    }
+  }
+  snprintf(out, 12, "\"%08lx\"", (unsigned long)h);
+}
+
+// Share of the free internal heap not in its largest block: 0 while one
+// malloc could still take all of it.
+static uint32_t heapFragPct(const hal::MemStats& m) {
+  return m.heapFree ? 100 - (uint32_t)((uint64_t)m.heapLargest * 100 / m.heapFree) : 0;
 }
 
 void handleStatus() {
-  bool sta = (WiFi.status() == WL_CONNECTED);
+  bool sta = hal::wifiStaConnected();
 
-  time_t now; time(&now);
+  time_t now = hal::wallTime();
   bool tOk = (now > 1000000000);
   if (!tOk) now = 0;
 
-  time_t nextTx = tOk ? computeNextTxEpoch(now) : 0;
-
-  String json = "{";
-  json += "\"hostname\":\"" + String(HOSTNAME) + "\",";
-  json += "\"sta_connected\":" + String(sta ? "true" : "false") + ",";
-  json += "\"sta_ip\":\"" + (sta ? WiFi.localIP().toString() : "") + "\",";
-  json += "\"ap_ip\":\"" + WiFi.softAPIP().toString() + "\",";
+  StateLock lock;
+  uint8_t nextBand = 0;
+  time_t nextTx = tOk ? computeNextTxEpoch(now, &nextBand) : 0;
+
+  JsonWriter w = beginJson();
+  w.beginObject();
+  w.field("hostname", HOSTNAME);
+  w.field("sta_connected", sta);
+  w.field("sta_ip", sta ? hal::wifiStaIp() : "");
+  w.field("ap_ip", hal::wifiApIp());
+
+  char ipText[16];
+  formatIp(staIp, ipText);
+  w.beginObject("wifi");
+  w.field("state", wifiStateName(wifi.state));
+  w.field("channel", (unsigned)staChannel);
+  w.field("cached_ap", staHintValid());
+  w.field("static_ip", staIp ? ipText : "");
+  if (staIp) {
+    formatIp(staGateway, ipText);
+    w.field("gateway", ipText);
+    formatIp(staNetmask, ipText);
+    w.field("netmask", ipText);
+    formatIp(staDns, ipText);
+    w.field("dns", staDns ? ipText : "");
+  }
+  w.field("last_assoc_ms", wifi.lastAssocMs);
+  w.field("connects", wifi.connects);
+  w.field("failures", wifi.failures);
+  w.field("drops", wifi.drops);
+  w.field("last_reason", (unsigned)wifi.lastReason);
+  w.endObject();
+
+  int64_t firstHttpUs = hal::httpFirstResponseUs();
+  w.beginObject("boot");
+  w.field("first_http_ms", (unsigned long)(firstHttpUs / 1000));
+  w.field("sta_up_ms", boot.staUpMs);
+  w.field("time_valid_ms", boot.timeValidMs);
+  w.endObject();
+
+  w.field("call", CALLSIGN);
+  w.field("loc", LOCATOR);
+  w.field("pwr_dbm", POWER_DBM);
+  w.beginArray("msg_types");   // sent in turn, one per frame
+  for (size_t i = 0; i < msgSeqLen; i++) w.value((int)msgSeq[i]->type);
+  w.endArray();
+  w.field("band", BANDS[bandIndex].name);
+  w.field("band_index", (int)bandIndex);
+
+  w.field("tx_enabled", txEnabled);
+  w.field("tx_every_slot", txEverySlot);
+  writeOutputs(w);
+
+  w.field("ntp_server", ntpServer);
+  w.beginObject("ntp");
+  w.field("state", ntpStateName(ntp.state));
+  w.field("last_sync_epoch", ntp.lastSyncEpoch);
+  w.field("offset_us", (long long)ntp.lastOffsetUs);
+  w.field("rtt_us", ntp.lastRttUs);
+  w.field("syncs", ntp.syncs);
+  w.field("failures", ntp.failures);
+  w.endObject();
+
+  w.beginObject("settings");
+  w.field("load_us", settingsStats.loadUs);
+  w.field("save_us", settingsStats.saveUs);
+  w.field("writes", settingsStats.writes);
+  w.field("skipped", settingsStats.skipped);
+  w.field("migrated", settingsStats.migrated);
+  w.endObject();
+
+  w.field("time_valid", tOk);
+  w.field("now_epoch", (uint32_t)now);
+  w.field("next_tx_epoch", (uint32_t)nextTx);
+  w.field("next_tx_band", nextTx ? BANDS[nextBand].name : "");
+  w.field("sched_mode", schedModeName(schedMode));
+  w.field("tx_pct", txPct);
+
+  w.beginObject("tx");
+  w.field("on", (bool)txNow.on);
+  if (txNow.on) {
+    w.field("band", BANDS[txNow.bands[0]].name);
+    w.beginArray("bands");
+    for (uint8_t k = 0; k < txNow.outputs; k++) w.value(BANDS[txNow.bands[k]].name);
+    w.endArray();
+    w.field("type", (unsigned)txNow.type);
+    w.field("start_epoch", txNow.startEpoch);
+  }
+  w.endObject();
+
+  w.beginObject("history");
+  w.field("frames", histNext);
+  w.field("ring", histCount);
+  w.field("ring_capacity", histCap);
+  w.field("unflushed", histNext - histFlushedTo);
+  w.field("log_mounted", histStats.fs);
+  w.field("log_bytes", histStats.logBytes);
+  w.field("flushes", histStats.flushes);
+  w.field("flush_failures", histStats.flushFailures);
+  w.endObject();
+
+  // Shares of uptime: RF keyed (duty cycle), held at full clock, and CPU
+  // busy as sampled by the RTOS tick (the rest ran slow or slept).
+  int64_t upUs = max(hal::monoUs(), (int64_t)1);
+  int64_t activeUs = hal::cpuActiveUs();
+  w.beginObject("power");
+  w.field("dfs", power.info.dfs);
+  w.field("light_sleep", power.info.lightSleep);
+  w.field("min_mhz", power.info.minMhz);
+  w.field("max_mhz", power.info.maxMhz);
+  w.field("uptime_s", (uint32_t)(upUs / 1000000));
+  w.field("cpu_active_s", (uint32_t)(activeUs / 1000000));
+  w.fixed("cpu_active_pct", activeUs * 100.0 / upUs, 1);
+  w.fixed("full_clock_pct", spanUs(power.heldUs, power.heldSinceUs, upUs) * 100.0 / upUs, 1);
+  w.fixed("tx_duty_pct", spanUs(power.keyedUs, power.keyedSinceUs, upUs) * 100.0 / upUs, 1);
+  w.endObject();
+
+  // The beacon and engine should stay flat once booted; "other" is the web
+  // server and network stack, which allocate per request.
+  hal::MemStats mem = hal::memStats();
+  hal::AllocCounts allocs = hal::allocCounts();
+  w.beginObject("memory");
+  w.field("heap_free", mem.heapFree);
+  w.field("heap_largest", mem.heapLargest);
+  w.field("heap_min_free", mem.heapMinFree);
+  w.field("heap_free_blocks", mem.heapFreeBlocks);
+  w.field("heap_used_blocks", mem.heapUsedBlocks);
+  w.field("heap_frag_pct", heapFragPct(mem));
+  w.beginObject("allocs");
+  w.field("beacon", allocs.beacon);
+  w.field("engine", allocs.engine);
+  w.field("other", allocs.other);
+  w.endObject();
+  w.endObject();
+
+  w.beginObject("push");
+  w.field("clients", (unsigned)hal::eventsClients());
+  w.field("events", eventSeq);
+  w.endObject();
+  w.endObject();
+  endJson(w);
+}
 
-  json += "\"call\":\"" + htmlEscape(CALLSIGN) + "\",";
-  json += "\"loc\":\"" + htmlEscape(LOCATOR) + "\",";
-  json += "\"pwr_dbm\":" + String(POWER_DBM) + ",";
-  json += "\"band\":\"" + String(BANDS[bandIndex].name) + "\",";
-  json += "\"band_index\":" + String((int)bandIndex) + ",";
+// Prometheus text format, for scraping the fleet. The counters need no
+// lock; the lock is only for the multi-word WiFi/NTP/timing state.
+void handleMetrics() {
+  hal::MemStats mem = hal::memStats();
+  hal::AllocCounts allocs = hal::allocCounts();
+  StateLock lock;
+  hal::httpBeginChunked(200, "text/plain; version=0.0.4");
+  MetricsWriter m(jsonBuf, sizeof(jsonBuf), hal::httpSendChunk);
+
+  m.family("wspr_uptime_seconds", "gauge", "Time since boot.");
+  m.seconds("wspr_uptime_seconds", hal::monoUs());
+  m.metric("wspr_heap_free_bytes", "gauge", "Free internal heap.", mem.heapFree);
+  m.metric("wspr_heap_largest_free_bytes", "gauge", "Largest free internal heap block.", mem.heapLargest);
+  m.metric("wspr_heap_min_free_bytes", "gauge", "Lowest free internal heap since boot.", mem.heapMinFree);
+  m.metric("wspr_heap_free_blocks", "gauge", "Free blocks in the internal heap.", mem.heapFreeBlocks);
+  m.metric("wspr_heap_used_blocks", "gauge", "Allocated blocks in the internal heap.", mem.heapUsedBlocks);
+  m.metric("wspr_heap_fragmentation_percent", "gauge", "Free internal heap outside the largest block.", heapFragPct(mem));
+  m.family("wspr_heap_allocs_total", "counter", "Heap allocations by calling task.");
+  m.sample("wspr_heap_allocs_total", allocs.beacon, "task", "beacon");
+  m.sample("wspr_heap_allocs_total", allocs.engine, "task", "engine");
+  m.sample("wspr_heap_allocs_total", allocs.other, "task", "other");
+  m.metric("wspr_psram_free_bytes", "gauge", "Free PSRAM.", mem.psramFree);
+  m.metric("wspr_psram_largest_free_bytes", "gauge", "Largest free PSRAM block.", mem.psramLargest);
+
+  m.family("wspr_frames_total", "counter", "Frames by outcome: sent, or why the slot was skipped.");
+  for (uint8_t o = 0; o < FRAME_OUTCOMES; o++) {
+    m.sample("wspr_frames_total", metrics.frames[o], "outcome", o ? HIST_ABORT_NAMES[o] : "sent");
+  }
+  m.metric("wspr_tx_active", "gauge", "1 while a frame is keyed.", txNow.on ? 1 : 0);
+  m.metric("wspr_i2c_writes_total", "counter", "Si5351 tone writes.", metrics.i2cWrites);
+  m.metric("wspr_i2c_errors_total", "counter", "Si5351 tone writes that failed.", metrics.i2cErrors);
+  if (timingCount) {
+    const FrameTiming& f = timingLog[(timingHead + TIMING_FRAMES - 1) % TIMING_FRAMES];
+    m.family("wspr_frame_start_error_seconds", "gauge", "Last frame: symbol 0 against the UTC slot start.");
+    m.seconds("wspr_frame_start_error_seconds", f.startErrUs);
+    m.family("wspr_frame_edge_error_p99_seconds", "gauge", "Last frame: 99th percentile symbol edge lateness.");
+    m.seconds("wspr_frame_edge_error_p99_seconds", f.edgeP99Us);
+    m.family("wspr_frame_edge_error_max_seconds", "gauge", "Last frame: worst symbol edge lateness.");
+    m.seconds("wspr_frame_edge_error_max_seconds", f.edgeMaxUs);
+  }
 
-  json += "\"tx_enabled\":" + String(txEnabled ? "true" : "false") + ",";
-  json += "\"tx_every_slot\":" + String(txEverySlot ? "true" : "false") + ",";
+  m.metric("wspr_wifi_sta_connected", "gauge", "1 while the station link is up.", hal::wifiStaConnected() ? 1 : 0);
+  m.metric("wspr_wifi_connects_total", "counter", "Station associations, reconnects included.", wifi.connects);
+  m.metric("wspr_wifi_failures_total", "counter", "Failed station association attempts.", wifi.failures);
+  m.metric("wspr_wifi_drops_total", "counter", "Station links lost.", wifi.drops);
+  m.metric("wspr_time_valid", "gauge", "1 once the clock is set.", timeValid() ? 1 : 0);
+  m.metric("wspr_ntp_syncs_total", "counter", "Successful NTP exchanges.", ntp.syncs);
+  m.metric("wspr_ntp_failures_total", "counter", "Failed NTP exchanges.", ntp.failures);
+  m.family("wspr_ntp_offset_seconds", "gauge", "Clock correction applied by the last sync.");
+  m.seconds("wspr_ntp_offset_seconds", ntp.lastOffsetUs);
+  m.family("wspr_ntp_rtt_seconds", "gauge", "Round trip of the last sync.");
+  m.seconds("wspr_ntp_rtt_seconds", ntp.lastRttUs);
+
+  m.family("wspr_wake_late_seconds", "summary", "Beacon loop: lateness of timed wakeups.");
+  m.seconds("wspr_wake_late_seconds_sum", metrics.wakeLateUs);
+  m.sample("wspr_wake_late_seconds_count", metrics.wakes);
+  m.family("wspr_wake_late_max_seconds", "gauge", "Beacon loop: latest timed wakeup since boot.");
+  m.seconds("wspr_wake_late_max_seconds", metrics.wakeLateMaxUs);
+  m.family("wspr_command_latency_seconds", "summary", "Web/WiFi/NTP commands: queued to applied.");
+  m.seconds("wspr_command_latency_seconds_sum", metrics.cmdLatencyUs);
+  m.sample("wspr_command_latency_seconds_count", metrics.commands);
+  m.family("wspr_command_latency_max_seconds", "gauge", "Slowest command pickup since boot.");
+  m.seconds("wspr_command_latency_max_seconds", metrics.cmdLatencyMaxUs);
+  m.family("wspr_command_service_seconds", "summary", "Time the beacon spent applying commands.");
+  m.seconds("wspr_command_service_seconds_sum", metrics.cmdServiceUs);
+  m.sample("wspr_command_service_seconds_count", metrics.commands);
+  m.family("wspr_command_service_max_seconds", "gauge", "Slowest command since boot.");
+  m.seconds("wspr_command_service_max_seconds", metrics.cmdServiceMaxUs);
+
+  m.family("wspr_http_requests_total", "counter", "HTTP requests by endpoint.");
+  for (uint8_t e = 0; e < EP_COUNT; e++) {
+    m.sample("wspr_http_requests_total", metrics.httpRequests[e], "path", ENDPOINT_PATHS[e]);
+  }
+  m.family("wspr_http_service_seconds", "summary", "HTTP handler time by endpoint.");
+  for (uint8_t e = 0; e < EP_COUNT; e++) {
+    m.seconds("wspr_http_service_seconds_sum", metrics.httpUs[e], "path", ENDPOINT_PATHS[e]);
+    m.sample("wspr_http_service_seconds_count", metrics.httpRequests[e], "path", ENDPOINT_PATHS[e]);
+  }
+  m.family("wspr_http_service_max_seconds", "gauge", "Slowest HTTP handler run since boot, by endpoint.");
+  for (uint8_t e = 0; e < EP_COUNT; e++) {
+    m.seconds("wspr_http_service_max_seconds", metrics.httpMaxUs[e], "path", ENDPOINT_PATHS[e]);
+  }
 
-  json += "\"ntp_server\":\"" + htmlEscape(ntpServer) + "\",";
+  m.finish();
+  hal::httpEndChunked();
+}
 
-  json += "\"time_valid\":" + String(tOk ? "true" : "false") + ",";
-  json += "\"now_epoch\":" + String((uint32_t)now) + ",";
-  json += "\"next_tx_epoch\":" + String((uint32_t)nextTx) + ",";
+void handleBands() {
+  StateLock lock;
+  char etag[12];
+  bandsEtag(etag);
+  hal::httpSendHeader("ETag", etag);
+  hal::httpSendHeader("Cache-Control", "no-cache");
+  if (strstr(hal::httpHeader("If-None-Match"), etag)) {
+    hal::httpSend(304);
+    return;
+  }
 
-  json += "\"bands\":[";
+  JsonWriter w = beginJson();
+  w.beginObject();
+  w.field("iaru_region", WSPR_IARU_REGION);
+  w.beginArray("bands");
   for (size_t i = 0; i < NUM_BANDS; i++) {
-    if (i) json += ",";
-    json += "{";
-    json += "\"name\":\"" + String(BANDS[i].name) + "\",";
-    json += "\"dial_hz\":" + String(BANDS[i].dial_hz, 1) + ",";
-    json += "\"cal_hz\":" + String(bandCalHz[i], 1) + ",";
-    json += "\"active\":" + String(i == bandIndex ? "true" : "false");
-    json += "}";
+    w.beginObject();
+    w.field("name", BANDS[i].name);
+    w.scaled("dial_hz", BANDS[i].dial_chz, 2);
+    w.fixed("cal_hz", bandCalHz[i], 1);
+    w.endObject();
+  }
+  w.endArray();
+  w.endObject();
+  endJson(w);
+}
+
+// Next N keyed slots, walked with computeNextTxEpoch()
+// straight into the response: ?n=1..SCHEDULE_MAX_N (default 10).
+static const int SCHEDULE_MAX_N = 360;
+
+void handleSchedule() {
+  int n = hal::httpHasArg("n") ? atoi(hal::httpArg("n")) : 10;
+  n = max(1, min(n, SCHEDULE_MAX_N));
+
+  time_t now = hal::wallTime();
+  bool tOk = timeValid();
+
+  StateLock lock;
+  JsonWriter w = beginJson();
+  w.beginObject();
+  w.field("mode", schedModeName(schedMode));
+  w.field("hop_mask", (unsigned)hopMask);
+  w.field("tx_pct", txPct);
+  w.field("tx_seed", txSeed);
+  w.field("tx_enabled", txEnabled);
+  w.field("time_valid", tOk);
+  if (schedMode == SchedMode::Custom) w.field("plan", customPlan);
+  w.beginArray("slots");
+  time_t t = now;
+  for (int i = 0; tOk && i < n; i++) {
+    uint8_t band;
+    t = computeNextTxEpoch(t, &band);
+    if (!t) break;
+    w.beginObject();
+    w.field("epoch", (unsigned long)t);
+    w.field("band", BANDS[band].name);
+    w.endObject();
+  }
+  w.endArray();
+  w.endObject();
+  endJson(w);
+}
+
+void handleTiming() {
+  StateLock lock;
+  JsonWriter w = beginJson();
+  w.beginObject();
+  w.beginArray("bucket_us");
+  for (uint8_t b = 0; b < TIMING_BUCKETS - 1; b++) {
+    w.value(TIMING_BUCKET_US[b]);
+  }
+  w.endArray();
+
+  // newest first
+  w.beginArray("frames");
+  for (uint8_t n = 0; n < timingCount; n++) {
+    const FrameTiming& f = timingLog[(timingHead + TIMING_FRAMES - 1 - n) % TIMING_FRAMES];
+    w.beginObject();
+    w.field("start_epoch", f.startEpoch);
+    w.field("band", BANDS[f.band].name);
+    w.field("start_err_us", f.startErrUs);
+    w.beginObject("edge_us");
+    w.field("min", f.edgeMinUs);
+    w.field("max", f.edgeMaxUs);
+    w.field("p50", f.edgeP50Us);
+    w.field("p99", f.edgeP99Us);
+    w.endObject();
+    w.field("i2c_max_us", f.writeMaxUs);
+    w.field("i2c_bytes", f.i2cBytes);
+    w.beginArray("hist");
+    for (uint8_t b = 0; b < TIMING_BUCKETS; b++) {
+      w.value(f.hist[b]);
+    }
+    w.endArray();
+    w.endObject();
+  }
+  w.endArray();
+  w.endObject();
+  endJson(w);
+}
+
+// /history?from=<seq>&n=<count>&format=csv|bin. Without `from` it returns
+// the newest page. X-History-First is the oldest seq on the device and
+// X-History-Next the `from` of the following page. bin is the raw
+// little-endian 48-byte HistoryRecord array.
+static const uint32_t HISTORY_PAGE_DEFAULT = 100;
+static const uint32_t HISTORY_PAGE_MAX = 250;
+static HistoryRecord histPage[8];   // handlers run one at a time
+
+void handleHistory() {
+  bool bin = argIs("format", "bin");
+  long n = hal::httpHasArg("n") ? atol(hal::httpArg("n")) : (long)HISTORY_PAGE_DEFAULT;
+  n = max(1L, min(n, (long)HISTORY_PAGE_MAX));
+
+  // The lock is only taken for the counters and, page by page, for the
+  // records still in the ring; file reads and the response go without it.
+  uint32_t next;
+  {
+    StateLock lock;
+    next = histNext;
+  }
+  uint32_t oldest = min(historyOldest(), next);
+  uint32_t from = next - min((uint32_t)n, next - oldest);
+  if (hal::httpHasArg("from")) {
+    from = (uint32_t)strtoul(hal::httpArg("from"), nullptr, 10);
+    from = max(oldest, min(from, next));
+  }
+  uint32_t end = from + min((uint32_t)n, next - from);
+
+  char num[12];
+  snprintf(num, sizeof(num), "%lu", (unsigned long)oldest);
+  hal::httpSendHeader("X-History-First", num);
+  snprintf(num, sizeof(num), "%lu", (unsigned long)end);
+  hal::httpSendHeader("X-History-Next", num);
+  hal::httpBeginChunked(200, bin ? "application/octet-stream" : "text/csv");
+  if (!bin) {
+    static const char head[] = "seq,start_epoch,clk,band,type,carrier_hz,scatter_hz,start_err_us,"
+                               "edge_p50_us,edge_p99_us,edge_max_us,write_max_us,i2c_bytes,symbols,abort\n";
+    hal::httpSendChunk(head, sizeof(head) - 1);
+  }
+
+  const size_t pageLen = sizeof(histPage) / sizeof(histPage[0]);
+  for (uint32_t seq = from; seq < end;) {
+    size_t k = historyRead(seq, histPage, min((size_t)(end - seq), pageLen));
+    if (!k) break;   // lost to a failed flush
+    seq += k;
+    if (bin) {
+      hal::httpSendChunk((const char*)histPage, k * sizeof(HistoryRecord));
+      continue;
+    }
+    for (size_t i = 0; i < k; i++) {
+      const HistoryRecord& r = histPage[i];
+      char hz[24] = "";
+      if (r.carrierCentiHz) {
+        snprintf(hz, sizeof(hz), "%lld.%02d", (long long)(r.carrierCentiHz / 100),
+                 (int)(r.carrierCentiHz % 100));
+      }
+      char line[160];
+      int len = snprintf(line, sizeof(line), "%lu,%lu,%u,%s,%u,%s,%d,%ld,%ld,%ld,%ld,%ld,%u,%u,%s\n",
+                         (unsigned long)r.seq, (unsigned long)r.startEpoch, (unsigned)r.clk,
+                         r.band < NUM_BANDS ? BANDS[r.band].name : "?", (unsigned)r.msgType, hz,
+                         (int)r.scatterHz, (long)r.startErrUs, (long)r.edgeP50Us,
+                         (long)r.edgeP99Us, (long)r.edgeMaxUs, (long)r.writeMaxUs,
+                         (unsigned)r.i2cBytes, (unsigned)r.symbols,
+                         r.abort < 4 ? HIST_ABORT_NAMES[r.abort] : "?");
+      hal::httpSendChunk(line, (size_t)min(len, (int)sizeof(line) - 1));
+    }
   }
-  json += "]";
+  hal::httpEndChunked();
+}
 
-  json += "}";
-  server.send(200, "application/json", json);
+// ---------- WIFI SCAN CACHE ----------
+// Scans run in the background and land in a small cache; /scan always
+// answers from it at once. A stale cache is refreshed on the next /scan,
+// and ?refresh=1 forces one, rate-limited to SCAN_MIN_GAP_MS.
+static const uint8_t SCAN_MAX = 16;
+static const uint32_t SCAN_MAX_AGE_MS = 300000;
+static const uint32_t SCAN_MIN_GAP_MS = 10000;
+
+struct ScanNet { char ssid[33]; int8_t rssi; };
+static ScanNet scanNets[SCAN_MAX];   // strongest first, one entry per SSID
+static uint8_t scanCount = 0;
+static bool scanHave = false;
+static bool scanRunning = false;
+static uint32_t scanStartMs = 0 - SCAN_MIN_GAP_MS;   // first scan not rate-limited
+static uint32_t scanDoneMs = 0;
+
+static void scanInsert(const char* ssid, int8_t rssi) {
+  if (!ssid[0]) return;   // hidden network
+  uint8_t i = 0;
+  for (; i < scanCount; i++) {
+    if (strcmp(scanNets[i].ssid, ssid) == 0) {
+      if (rssi <= scanNets[i].rssi) return;
+      memmove(&scanNets[i], &scanNets[i + 1], (scanCount - i - 1) * sizeof(ScanNet));
+      scanCount--;
+      break;
+    }
+  }
+  uint8_t pos = 0;
+  while (pos < scanCount && scanNets[pos].rssi >= rssi) pos++;
+  if (pos == SCAN_MAX) return;
+  if (scanCount == SCAN_MAX) scanCount--;
+  memmove(&scanNets[pos + 1], &scanNets[pos], (scanCount - pos) * sizeof(ScanNet));
+  strlcpy(scanNets[pos].ssid, ssid, sizeof(scanNets[pos].ssid));
+  scanNets[pos].rssi = rssi;
+  scanCount++;
+}
+
+static void onScanDone(int n) {
+  {
+    StateLock lock;
+    scanRunning = false;
+    if (n >= 0) {
+      scanCount = 0;
+      for (int i = 0; i < n; i++) {
+        scanInsert(hal::wifiScanSsid(i), (int8_t)hal::wifiScanRssi(i));
+      }
+      scanHave = true;
+      scanDoneMs = hal::monoMs();
+    }
+  }
+  hal::wifiScanDelete();
+}
+
+// Caller must not hold the state lock: done() may fire before this returns.
+static void startScan() {
+  {
+    StateLock lock;
+    if (scanRunning) return;
+    scanRunning = true;
+    scanStartMs = hal::monoMs();
+  }
+  if (!hal::wifiScanStart(onScanDone)) {
+    StateLock lock;
+    scanRunning = false;
+  }
 }
 
 void handleScan() {
-  int n = WiFi.scanNetworks(false, true);
-  String json = "{\"networks\":[";
-  for (int i = 0; i < n; i++) {
-    if (i) json += ",";
-    String ssid = WiFi.SSID(i);
-    int rssi = WiFi.RSSI(i);
-    ssid.replace("\"", "\\\"");
-    json += "{\"ssid\":\"" + ssid + "\",\"rssi\":" + String(rssi) + "}";
+  bool refresh = argIs("refresh", "1");
+  uint32_t nowMs = hal::monoMs();
+  bool start;
+  {
+    StateLock lock;
+    bool stale = !scanHave || nowMs - scanDoneMs > SCAN_MAX_AGE_MS;
+    start = !scanRunning && (stale || refresh) && nowMs - scanStartMs >= SCAN_MIN_GAP_MS;
+  }
+  if (start) startScan();
+
+  StateLock lock;
+  JsonWriter w = beginJson();
+  w.beginObject();
+  w.field("scanning", scanRunning);
+  w.field("age_s", scanHave ? (long)((nowMs - scanDoneMs) / 1000) : -1L);
+  w.beginArray("networks");
+  for (uint8_t i = 0; i < scanCount; i++) {
+    w.beginObject();
+    w.field("ssid", scanNets[i].ssid);
+    w.field("rssi", scanNets[i].rssi);
+    w.endObject();
   }
-  json += "]}";
-  WiFi.scanDelete();
-  server.send(200, "application/json", json);
+  w.endArray();
+  w.endObject();
+  endJson(w);
 }
 
+// Dotted quad -> (a << 24) | ... | d; empty is 0 (unset).
+static bool parseIp(const char* p, uint32_t* out) {
+  *out = 0;
+  if (!*p) return true;
+  for (int i = 0; i < 4; i++) {
+    if (!isdigit((unsigned char)*p)) return false;
+    char* end;
+    unsigned long v = strtoul(p, &end, 10);
+    if (v > 255 || end - p > 3) return false;
+    *out = (*out << 8) | v;
+    p = end;
+    if (i < 3 && *p++ != '.') return false;
+  }
+  return *p == 0;
+}
+
+// ssid, pass; optional ip/gw/mask/dns for a static address (blank: DHCP).
 void handleSaveWifi() {
-  if (!server.hasArg("ssid")) { server.send(400, "text/plain", "Missing ssid"); return; }
-  wifiSsid = server.arg("ssid");
-  wifiPass = server.hasArg("pass") ? server.arg("pass") : "";
-  saveSettings();
-  server.send(200, "text/plain", "OK");
+  if (!hal::httpHasArg("ssid")) { hal::httpSend(400, "text/plain", "Missing ssid"); return; }
+  Command c = {};
+  c.type = CmdType::SaveWifi;
+  strlcpy(c.ssid, hal::httpArg("ssid"), sizeof(c.ssid));
+  if (hal::httpHasArg("pass")) strlcpy(c.pass, hal::httpArg("pass"), sizeof(c.pass));
+  if (!parseIp(hal::httpArg("ip"), &c.staIp) || !parseIp(hal::httpArg("gw"), &c.staGateway) ||
+      !parseIp(hal::httpArg("mask"), &c.staNetmask) || !parseIp(hal::httpArg("dns"), &c.staDns)) {
+    hal::httpSend(400, "text/plain", "Bad IP address"); return;
+  }
+  if (c.staIp && (!c.staGateway || !c.staNetmask)) {
+    hal::httpSend(400, "text/plain", "Static IP needs gateway and netmask"); return;
+  }
+  if (!c.staIp) c.staGateway = c.staNetmask = c.staDns = 0;
+  postCommand(c);
 }
 
 void handleSaveNtp() {
-  if (!server.hasArg("ntp")) { server.send(400, "text/plain", "Missing ntp"); return; }
-  ntpServer = server.arg("ntp");
-  ntpServer.trim();
-  if (ntpServer.isEmpty()) ntpServer = DEFAULT_NTP_SERVER;
-  saveSettings();
-  server.send(200, "text/plain", "OK");
+  if (!hal::httpHasArg("ntp")) { hal::httpSend(400, "text/plain", "Missing ntp"); return; }
+  const char* ntp = argTrimmed("ntp");
+  if (!ntp) { hal::httpSend(400, "text/plain", "Bad ntp"); return; }
+  if (!*ntp) ntp = DEFAULT_NTP_SERVER;
+  Command c = {};
+  c.type = CmdType::SaveNtp;
+  strlcpy(c.ntp, ntp, sizeof(c.ntp));
+  postCommand(c);
 }
 
-static bool isValidCallsign(String c) {
-  c.trim(); c.toUpperCase();
-  if (c.length() < 3 || c.length() > 6) return false;
-  for (size_t i = 0; i < c.length(); i++) if (!isalnum((unsigned char)c[i])) return false;
+static bool isAlnumRun(const char* s, size_t n) {
+  for (size_t i = 0; i < n; i++) if (!isalnum((unsigned char)s[i])) return false;
   return true;
 }
 
-static bool isValidLocator(String g) {
-  g.trim(); g.toUpperCase();
-  if (g.length() != 4) return false;
+static bool isPlainCall(const char* s, size_t n) {
+  return n >= 3 && n <= 6 && isAlnumRun(s, n);
+}
+
+// Plain call, or a compound one as Type 2 can carry it: a 1-3 character
+// prefix (PJ4/K1ABC) or a one-character / two-digit suffix (K1ABC/P).
+// Expects it trimmed and upper-cased.
+static bool isValidCallsign(const char* s) {
+  const char* slash = strchr(s, '/');
+  if (!slash) return isPlainCall(s, strlen(s));
+  if (strchr(slash + 1, '/')) return false;
+  const size_t head = (size_t)(slash - s);
+  const char* tail = slash + 1;
+  const size_t tailLen = strlen(tail);
+  if (head >= 1 && head <= 3 && isAlnumRun(s, head) && isPlainCall(tail, tailLen)) return true;
+  if (!isPlainCall(s, head)) return false;
+  if (tailLen == 1) return isalnum((unsigned char)tail[0]);
+  return tailLen == 2 && isdigit((unsigned char)tail[0]) && isdigit((unsigned char)tail[1]);
+}
+
+// 4-char square (IO91) or 6-char subsquare (IO91WM), trimmed and upper-cased.
+static bool isValidLocator(const char* g) {
+  const size_t n = strlen(g);
+  if (n != 4 && n != 6) return false;
+  if (n == 6 && !(g[4] >= 'A' && g[4] <= 'X' && g[5] >= 'A' && g[5] <= 'X')) return false;
   return (g[0] >= 'A' && g[0] <= 'R' &&
           g[1] >= 'A' && g[1] <= 'R' &&
           isdigit((unsigned char)g[2]) &&
@@ -871,284 +2580,816 @@ static bool isValidLocator(String g) {
 
 void handleSaveWspr() {
   // required fields
-  String call = server.arg("call");
-  String loc  = server.arg("loc");
-  int pwr     = server.arg("pwr").toInt();
-  int b       = server.arg("band").toInt();
-
-  bool newTxEn  = server.hasArg("txen") ? (server.arg("txen") == "1") : txEnabled;
-  bool newTxAll = server.hasArg("txall") ? (server.arg("txall") == "1") : txEverySlot;
-
-  call.trim(); call.toUpperCase();
-  loc.trim();  loc.toUpperCase();
+  const char* call = argTrimmed("call", true);
+  const char* loc  = argTrimmed("loc", true);
+  int pwr     = atoi(hal::httpArg("pwr"));
+  int b       = atoi(hal::httpArg("band"));
+
+  bool newTxEn, newTxAll;
+  {
+    StateLock lock;
+    newTxEn  = hal::httpHasArg("txen") ? argIs("txen", "1") : txEnabled;
+    newTxAll = hal::httpHasArg("txall") ? argIs("txall", "1") : txEverySlot;
+  }
 
-  if (!isValidCallsign(call)) { server.send(400, "text/plain", "Bad callsign"); return; }
-  if (!isValidLocator(loc))   { server.send(400, "text/plain", "Bad locator (4 chars)"); return; }
-  if (pwr < 0 || pwr > 60)     { server.send(400, "text/plain", "Bad power"); return; }
-  if (b < 0 || (size_t)b >= NUM_BANDS) { server.send(400, "text/plain", "Bad band"); return; }
+  if (!call || !isValidCallsign(call)) { hal::httpSend(400, "text/plain", "Bad callsign"); return; }
+  if (!loc || !isValidLocator(loc)) { hal::httpSend(400, "text/plain", "Bad locator (4 or 6 chars)"); return; }
+  if (strchr(call, '/') && strlen(loc) != 6) {
+    // Type 2 carries no locator; the Type 3 that follows needs all six.
+    hal::httpSend(400, "text/plain", "Compound calls need a 6-char locator"); return;
+  }
+  if (!isValidPowerDbm(pwr))   { hal::httpSend(400, "text/plain", "Bad power (0-60 dBm, ending 0, 3 or 7)"); return; }
+  if (b < 0 || (size_t)b >= NUM_BANDS) { hal::httpSend(400, "text/plain", "Bad band"); return; }
+
+  Command c = {};
+  c.type = CmdType::SaveWspr;
+  strlcpy(c.call, call, sizeof(c.call));
+  strlcpy(c.loc, loc, sizeof(c.loc));
+  c.pwr = (uint8_t)pwr;
+  c.band = (uint8_t)b;
+  c.txEnabled = newTxEn;
+  c.txEverySlot = newTxAll;
+
+  // Extra outputs: band1/band2 = band index for CLK1/CLK2, -1 off. If a
+  // field is missing, keep current.
+  {
+    StateLock lock;
+    memcpy(c.extraBand, extraBand, sizeof(c.extraBand));
+  }
+  for (uint8_t k = 0; k < TX_OUTPUTS - 1; k++) {
+    char key[8];
+    snprintf(key, sizeof(key), "band%u", (unsigned)(k + 1));
+    if (!hal::httpHasArg(key)) continue;
+    int eb = atoi(hal::httpArg(key));
+    if (eb < -1 || eb >= (int)NUM_BANDS) { hal::httpSend(400, "text/plain", "Bad output band"); return; }
+    c.extraBand[k] = eb < 0 ? OUT_OFF : (uint8_t)eb;
+  }
+  if (c.extraBand[0] != OUT_OFF && c.extraBand[0] == c.extraBand[1]) {
+    hal::httpSend(400, "text/plain", "CLK1 and CLK2 need different bands"); return;
+  }
+  for (uint8_t k = 0; k < TX_OUTPUTS; k++) {
+    char key[8];
+    snprintf(key, sizeof(key), "ocal_%u", (unsigned)k);
+    if (hal::httpHasArg(key)) {
+      c.outCalSet[k] = true;
+      if (!parseCalHz(hal::httpArg(key), &c.outCalHz[k])) {
+        hal::httpSend(400, "text/plain", "Bad output calibration (max 10 kHz)"); return;
+      }
+    }
+  }
 
   // parse per-band calibration fields (cal_0..cal_10). If a field is missing, keep current.
   for (size_t i = 0; i < NUM_BANDS; i++) {
-    String k = "cal_" + String((int)i);
-    if (server.hasArg(k)) {
-      bandCalHz[i] = server.arg(k).toDouble();
+    char k[8];
+    snprintf(k, sizeof(k), "cal_%u", (unsigned)i);
+    if (hal::httpHasArg(k)) {
+      c.calSet[i] = true;
+      if (!parseCalHz(hal::httpArg(k), &c.calHz[i])) {
+        hal::httpSend(400, "text/plain", "Bad calibration (max 10 kHz)"); return;
+      }
     }
   }
 
-  CALLSIGN  = call;
-  LOCATOR   = loc;
-  POWER_DBM = (uint8_t)pwr;
-  bandIndex = (size_t)b;
+  postCommand(c);
+}
 
-  txEnabled   = newTxEn;
-  txEverySlot = newTxAll;
+// mode=single|hop|custom, hopmask=<bits of BANDS[0..9]>, plan=<720 chars>,
+// txpct=1..100 (share of the planned slots keyed)
+void handleSaveSchedule() {
+  Command c = {};
+  c.type = CmdType::SaveSchedule;
+  if (argIs("mode", "hop")) c.schedMode = (uint8_t)SchedMode::Hop;
+  else if (argIs("mode", "custom")) c.schedMode = (uint8_t)SchedMode::Custom;
+  else if (argIs("mode", "single")) c.schedMode = (uint8_t)SchedMode::Single;
+  else { hal::httpSend(400, "text/plain", "Bad mode"); return; }
+
+  {
+    StateLock lock;
+    c.hopMask = hopMask;
+    c.txPct = txPct;
+  }
+  if (hal::httpHasArg("hopmask")) {
+    long m = atol(hal::httpArg("hopmask"));
+    if (!isValidHopMask(m)) { hal::httpSend(400, "text/plain", "Bad hop mask"); return; }
+    c.hopMask = (uint16_t)m;
+  }
 
-  saveSettings();
-  server.send(200, "text/plain", "OK");
-}
+  if (hal::httpHasArg("txpct")) {
+    long pct = atol(hal::httpArg("txpct"));
+    if (pct < 1 || pct > 100) { hal::httpSend(400, "text/plain", "Bad Tx% (1-100)"); return; }
+    c.txPct = (uint8_t)pct;
+  }
 
-void handleSyncTime() {
-  bool ok = syncNtpTime();
-  server.send(200, "text/plain", ok ? "OK" : "FAIL");
+  if (hal::httpHasArg("plan")) {
+    // Whitespace dropped, lower-cased; anything past 720 slots is invalid.
+    char* plan = arenaAlloc(SLOTS_PER_DAY + 2);
+    size_t n = 0;
+    for (const char* a = hal::httpArg("plan"); plan && *a && n <= SLOTS_PER_DAY; a++) {
+      if (!isspace((unsigned char)*a)) plan[n++] = (char)tolower((unsigned char)*a);
+    }
+    if (plan) plan[n] = 0;
+    if (!plan || !isValidPlan(plan)) { hal::httpSend(400, "text/plain", "Bad plan (720 slots of 0-9, a, -)"); return; }
+    strlcpy(c.plan, plan, sizeof(c.plan));
+  } else if (c.schedMode == (uint8_t)SchedMode::Custom) {
+    StateLock lock;
+    if (!isValidPlan(customPlan)) { hal::httpSend(400, "text/plain", "No custom plan stored"); return; }
+  }
+
+  postCommand(c);
 }
 
-void handleReboot() {
-  server.send(200, "text/plain", "Rebooting");
-  delay(200);
-  ESP.restart();
+// GET /config returns every setting as one JSON document and PUT /config
+// takes the same document back: keys left out keep their current value,
+// everything is validated before anything changes, and the beacon applies
+// it as one command with one settings blob write. wifi.pass is write-only.
+//
+//   { "wifi": { "ssid": "", "pass": "", "ip": "", "gateway": "", "netmask": "", "dns": "" },
+//     "ntp_server": "", "call": "", "loc": "", "pwr_dbm": 10, "band_index": 3,
+//     "tx_enabled": false, "tx_every_slot": false, "cal_hz": [ 11 x Hz ],
+//     "extra_band": [ -1, -1 ], "out_cal_hz": [ 0, 0, 0 ],
+//     "sched_mode": "single", "hop_mask": 1023, "tx_pct": 100, "plan": "" }
+void handleConfigGet() {
+  StateLock lock;
+  char ipText[16];
+  JsonWriter w = beginJson();
+  w.beginObject();
+  w.beginObject("wifi");
+  w.field("ssid", wifiSsid);
+  formatIp(staIp, ipText);
+  w.field("ip", staIp ? ipText : "");
+  formatIp(staGateway, ipText);
+  w.field("gateway", staGateway ? ipText : "");
+  formatIp(staNetmask, ipText);
+  w.field("netmask", staNetmask ? ipText : "");
+  formatIp(staDns, ipText);
+  w.field("dns", staDns ? ipText : "");
+  w.endObject();
+  w.field("ntp_server", ntpServer);
+  w.field("call", CALLSIGN);
+  w.field("loc", LOCATOR);
+  w.field("pwr_dbm", POWER_DBM);
+  w.field("band_index", (unsigned)bandIndex);
+  w.field("tx_enabled", txEnabled);
+  w.field("tx_every_slot", txEverySlot);
+  w.beginArray("cal_hz");
+  for (size_t i = 0; i < NUM_BANDS; i++) w.fixedValue(bandCalHz[i], 2);
+  w.endArray();
+  w.beginArray("extra_band");
+  for (uint8_t k = 0; k < TX_OUTPUTS - 1; k++) w.value(extraBand[k] == OUT_OFF ? -1 : (int)extraBand[k]);
+  w.endArray();
+  w.beginArray("out_cal_hz");
+  for (uint8_t k = 0; k < TX_OUTPUTS; k++) w.fixedValue(outCalHz[k], 2);
+  w.endArray();
+  w.field("sched_mode", schedModeName(schedMode));
+  w.field("hop_mask", hopMask);
+  w.field("tx_pct", txPct);
+  w.field("plan", customPlan);
+  w.endObject();
+  endJson(w);
 }
 
-void handleFavicon() {
-  server.send(204); // No Content
+// Cuts surrounding blanks in place, upper-casing if asked.
+static char* trimInPlace(char* s, bool upper) {
+  while (isspace((unsigned char)*s)) s++;
+  size_t n = strlen(s);
+  while (n && isspace((unsigned char)s[n - 1])) n--;
+  s[n] = 0;
+  if (upper) for (char* p = s; *p; p++) *p = (char)toupper((unsigned char)*p);
+  return s;
 }
 
-void startWeb() {
-  server.on("/", handleRoot);
-  server.on("/status", handleStatus);
-  server.on("/scan", handleScan);
+static char configError[48];
 
-  server.on("/save_wifi", HTTP_POST, handleSaveWifi);
-  server.on("/save_ntp", HTTP_POST, handleSaveNtp);
-  server.on("/save_wspr", HTTP_POST, handleSaveWspr);
+// "Bad <prefix><key>[ (<why>)]" for the response; always false.
+static bool configFail(const char* prefix, const char* key, const char* why = nullptr) {
+  snprintf(configError, sizeof(configError), "Bad %s%s%s%s%s", prefix, key,
+           why ? " (" : "", why ? why : "", why ? ")" : "");
+  return false;
+}
 
-  server.on("/sync_time", HTTP_POST, handleSyncTime);
+static bool configUnknown(const char* prefix, const char* key) {
+  snprintf(configError, sizeof(configError), "Unknown key %s%s", prefix, key);
+  return false;
+}
 
-  server.on("/reboot", HTTP_POST, handleReboot);
-  server.on("/favicon.ico", HTTP_GET, handleFavicon);
+// Exactly n calibration values into out.
+static bool readCalHz(JsonReader& r, double* out, size_t n) {
+  if (!r.beginArray()) return false;
+  size_t i = 0;
+  while (r.nextItem()) {
+    if (i == n || !r.number(&out[i]) || !isValidCalHz(out[i])) return false;
+    i++;
+  }
+  return r.ok() && i == n;
+}
 
-  server.onNotFound(handleCaptivePortal);
+static bool readWifi(JsonReader& r, Command& c) {
+  char key[16];
+  if (!r.beginObject()) return configFail("", "wifi");
+  while (r.nextKey(key, sizeof(key))) {
+    uint32_t* ip = !strcmp(key, "ip") ? &c.staIp : !strcmp(key, "gateway") ? &c.staGateway
+                 : !strcmp(key, "netmask") ? &c.staNetmask : !strcmp(key, "dns") ? &c.staDns : nullptr;
+    if (!strcmp(key, "ssid")) {
+      if (!r.string(c.ssid, sizeof(c.ssid))) return configFail("wifi.", key);
+    } else if (!strcmp(key, "pass")) {
+      if (!r.string(c.pass, sizeof(c.pass))) return configFail("wifi.", key);
+    } else if (ip) {
+      char text[16];
+      if (!r.string(text, sizeof(text)) || !parseIp(trimInPlace(text, false), ip)) {
+        return configFail("wifi.", key, "IP address");
+      }
+    } else {
+      return configUnknown("wifi.", key);
+    }
+  }
+  return r.ok() || configFail("", "wifi");
+}
 
-  server.begin();
-  Serial.println("Web server started (port 80)");
+// One top-level member into c; false with configError set.
+static bool readConfigKey(JsonReader& r, const char* key, Command& c) {
+  long v;
+  if (!strcmp(key, "wifi")) return readWifi(r, c);
+  if (!strcmp(key, "ntp_server")) {
+    char ntp[sizeof(c.ntp)];
+    if (!r.string(ntp, sizeof(ntp))) return configFail("", key);
+    const char* t = trimInPlace(ntp, false);
+    strlcpy(c.ntp, *t ? t : DEFAULT_NTP_SERVER, sizeof(c.ntp));
+    return true;
+  }
+  if (!strcmp(key, "call")) {
+    char call[sizeof(c.call)];
+    const char* t = r.string(call, sizeof(call)) ? trimInPlace(call, true) : "";
+    if (!isValidCallsign(t)) return configFail("", key);
+    strlcpy(c.call, t, sizeof(c.call));
+    return true;
+  }
+  if (!strcmp(key, "loc")) {
+    char loc[sizeof(c.loc)];
+    const char* t = r.string(loc, sizeof(loc)) ? trimInPlace(loc, true) : "";
+    if (!isValidLocator(t)) return configFail("", key, "4 or 6 chars");
+    strlcpy(c.loc, t, sizeof(c.loc));
+    return true;
+  }
+  if (!strcmp(key, "pwr_dbm")) {
+    if (!r.integer(&v, 0, 60) || !isValidPowerDbm(v)) return configFail("", key, "ends 0, 3 or 7");
+    c.pwr = (uint8_t)v;
+    return true;
+  }
+  if (!strcmp(key, "band_index")) {
+    if (!r.integer(&v, 0, (long)NUM_BANDS - 1)) return configFail("", key);
+    c.band = (uint8_t)v;
+    return true;
+  }
+  if (!strcmp(key, "tx_enabled")) return r.boolean(&c.txEnabled) || configFail("", key);
+  if (!strcmp(key, "tx_every_slot")) return r.boolean(&c.txEverySlot) || configFail("", key);
+  if (!strcmp(key, "cal_hz")) {
+    return readCalHz(r, c.calHz, NUM_BANDS) || configFail("", key, "per band, max 10 kHz");
+  }
+  if (!strcmp(key, "out_cal_hz")) {
+    return readCalHz(r, c.outCalHz, TX_OUTPUTS) || configFail("", key, "per output, max 10 kHz");
+  }
+  if (!strcmp(key, "extra_band")) {
+    uint8_t k = 0;
+    if (!r.beginArray()) return configFail("", key);
+    while (r.nextItem()) {
+      if (k == TX_OUTPUTS - 1 || !r.integer(&v, -1, (long)NUM_BANDS - 1)) return configFail("", key);
+      c.extraBand[k++] = v < 0 ? OUT_OFF : (uint8_t)v;
+    }
+    return (r.ok() && k == TX_OUTPUTS - 1) || configFail("", key);
+  }
+  if (!strcmp(key, "sched_mode")) {
+    char mode[8];
+    if (!r.string(mode, sizeof(mode))) return configFail("", key);
+    if (!strcmp(mode, "single")) c.schedMode = (uint8_t)SchedMode::Single;
+    else if (!strcmp(mode, "hop")) c.schedMode = (uint8_t)SchedMode::Hop;
+    else if (!strcmp(mode, "custom")) c.schedMode = (uint8_t)SchedMode::Custom;
+    else return configFail("", key);
+    return true;
+  }
+  if (!strcmp(key, "hop_mask")) {
+    if (!r.integer(&v, 0, 0xFFFF) || !isValidHopMask(v)) return configFail("", key);
+    c.hopMask = (uint16_t)v;
+    return true;
+  }
+  if (!strcmp(key, "tx_pct")) {
+    if (!r.integer(&v, 1, 100)) return configFail("", key, "1-100");
+    c.txPct = (uint8_t)v;
+    return true;
+  }
+  if (!strcmp(key, "plan")) {
+    // As /save_schedule: whitespace dropped, lower-cased; "" keeps the stored one.
+    const size_t cap = ARENA_BYTES - arenaUsed;
+    char* raw = arenaAlloc(cap);
+    if (!raw || !r.string(raw, cap)) return configFail("", key);
+    size_t n = 0;
+    for (const char* a = raw; *a && n <= SLOTS_PER_DAY; a++) {
+      if (!isspace((unsigned char)*a)) raw[n++] = (char)tolower((unsigned char)*a);
+    }
+    raw[n] = 0;
+    if (n && !isValidPlan(raw)) return configFail("", key, "720 slots of 0-9, a, -");
+    strlcpy(c.plan, raw, sizeof(c.plan));
+    return true;
+  }
+  return configUnknown("", key);
 }
 
-// ---------- WAIT FOR NEXT SLOT ----------
-void serviceNetworkWhileWaiting(uint32_t waitMs) {
-  uint32_t endMs = millis() + waitMs;
-  while ((int32_t)(endMs - millis()) > 0) {
-    server.handleClient();
-    if (captivePortalActive) dnsServer.processNextRequest();
-    delay(5);
+void handleConfigPut() {
+  const char* body = hal::httpBody();
+  if (!body) { hal::httpSend(413, "text/plain", "Missing or oversized JSON body"); return; }
+
+  // Start from the settings as they are: the document only overrides.
+  Command c = {};
+  c.type = CmdType::Config;
+  bool planStored;
+  {
+    StateLock lock;
+    strlcpy(c.ssid, wifiSsid, sizeof(c.ssid));
+    strlcpy(c.pass, wifiPass, sizeof(c.pass));
+    c.staIp = staIp;
+    c.staGateway = staGateway;
+    c.staNetmask = staNetmask;
+    c.staDns = staDns;
+    strlcpy(c.ntp, ntpServer, sizeof(c.ntp));
+    strlcpy(c.call, CALLSIGN, sizeof(c.call));
+    strlcpy(c.loc, LOCATOR, sizeof(c.loc));
+    c.pwr = POWER_DBM;
+    c.band = (uint8_t)bandIndex;
+    c.txEnabled = txEnabled;
+    c.txEverySlot = txEverySlot;
+    for (size_t i = 0; i < NUM_BANDS; i++) {
+      c.calSet[i] = true;
+      c.calHz[i] = bandCalHz[i];
+    }
+    for (uint8_t k = 0; k < TX_OUTPUTS; k++) {
+      c.outCalSet[k] = true;
+      c.outCalHz[k] = outCalHz[k];
+    }
+    memcpy(c.extraBand, extraBand, sizeof(c.extraBand));
+    c.schedMode = (uint8_t)schedMode;
+    c.hopMask = hopMask;
+    c.txPct = txPct;
+    planStored = isValidPlan(customPlan);
+  }
+
+  JsonReader r(body, strlen(body));
+  char key[16];
+  configError[0] = 0;
+  bool ok = r.beginObject();
+  while (ok && r.nextKey(key, sizeof(key))) ok = readConfigKey(r, key, c);
+  if (!ok || !r.done()) {
+    if (!configError[0]) snprintf(configError, sizeof(configError), "Bad JSON at byte %u", (unsigned)r.errorAt());
+    hal::httpSend(400, "text/plain", configError);
+    return;
+  }
+
+  // Checks across keys, as the form handlers make them.
+  if (c.staIp && (!c.staGateway || !c.staNetmask)) {
+    hal::httpSend(400, "text/plain", "Static IP needs gateway and netmask"); return;
   }
+  if (!c.staIp) c.staGateway = c.staNetmask = c.staDns = 0;
+  if (strchr(c.call, '/') && strlen(c.loc) != 6) {
+    hal::httpSend(400, "text/plain", "Compound calls need a 6-char locator"); return;
+  }
+  if (c.extraBand[0] != OUT_OFF && c.extraBand[0] == c.extraBand[1]) {
+    hal::httpSend(400, "text/plain", "CLK1 and CLK2 need different bands"); return;
+  }
+  if (c.schedMode == (uint8_t)SchedMode::Custom && !c.plan[0] && !planStored) {
+    hal::httpSend(400, "text/plain", "No custom plan stored"); return;
+  }
+
+  postCommand(c);
+}
+
+// NTP sync runs on the beacon; the page re-reads /status for the result.
+void handleSyncTime() {
+  Command c = {};
+  c.type = CmdType::SyncTime;
+  postCommand(c);
 }
 
-void waitForNextSlot() {
-  time_t now;
-  time(&now);
+void handleReboot() {
+  Command c = {};
+  c.type = CmdType::Reboot;
+  postCommand(c);
+}
+
+void handleFavicon() {
+  hal::httpSend(204); // No Content
+}
+
+// Wraps a handler with its request count and service time, and frees its
+// arena scratch (web task only).
+template <void (*Handler)(), Endpoint E>
+static void metered() {
+  const int64_t t0 = hal::monoUs();
+  Handler();
+  arenaUsed = 0;
+  metricBump(metrics.httpRequests[E]);
+  metricObserve(metrics.httpUs[E], metrics.httpMaxUs[E], hal::monoUs() - t0);
+}
 
-  time_t nextSlot = computeNextTxEpoch(now);
-  int waitSec = max(0, (int)(nextSlot - now));
+static void route(Endpoint e, hal::HttpMethod method, hal::HttpHandler handler) {
+  hal::httpOn(ENDPOINT_PATHS[e], method, handler);
+}
+
+void startWeb() {
+  route(EP_ROOT, hal::HttpMethod::Any, metered<handleRoot, EP_ROOT>);
+  route(EP_STATUS, hal::HttpMethod::Any, metered<handleStatus, EP_STATUS>);
+  route(EP_METRICS, hal::HttpMethod::Get, metered<handleMetrics, EP_METRICS>);
+  route(EP_SCAN, hal::HttpMethod::Any, metered<handleScan, EP_SCAN>);
+  route(EP_BANDS, hal::HttpMethod::Get, metered<handleBands, EP_BANDS>);
+  route(EP_SCHEDULE, hal::HttpMethod::Get, metered<handleSchedule, EP_SCHEDULE>);
+  route(EP_TIMING, hal::HttpMethod::Get, metered<handleTiming, EP_TIMING>);
+  route(EP_HISTORY, hal::HttpMethod::Get, metered<handleHistory, EP_HISTORY>);
+
+  route(EP_SAVE_WIFI, hal::HttpMethod::Post, metered<handleSaveWifi, EP_SAVE_WIFI>);
+  route(EP_SAVE_NTP, hal::HttpMethod::Post, metered<handleSaveNtp, EP_SAVE_NTP>);
+  route(EP_SAVE_WSPR, hal::HttpMethod::Post, metered<handleSaveWspr, EP_SAVE_WSPR>);
+  route(EP_SAVE_SCHEDULE, hal::HttpMethod::Post, metered<handleSaveSchedule, EP_SAVE_SCHEDULE>);
+  route(EP_CONFIG, hal::HttpMethod::Get, metered<handleConfigGet, EP_CONFIG>);
+  route(EP_CONFIG, hal::HttpMethod::Put, metered<handleConfigPut, EP_CONFIG>);
+
+  route(EP_SYNC_TIME, hal::HttpMethod::Post, metered<handleSyncTime, EP_SYNC_TIME>);
+
+  route(EP_REBOOT, hal::HttpMethod::Post, metered<handleReboot, EP_REBOOT>);
+  route(EP_FAVICON, hal::HttpMethod::Get, metered<handleFavicon, EP_FAVICON>);
+
+  hal::eventsBegin("/events");
+  hal::httpOnNotFound(metered<handleCaptivePortal, EP_OTHER>);
+
+  hal::httpCollectHeaders(WEB_HEADERS, sizeof(WEB_HEADERS) / sizeof(WEB_HEADERS[0]));
+  hal::httpBegin(80);
+  Serial.println("Web server started (port 80)");
+}
+
+// ---------- WAIT FOR NEXT SLOT ----------
+// Sleeps until TX_PREP_LEAD_US before the next planned frame and stores its
+// start (UTC us) and band. Returns false if a settings change cut the wait
+// short or nothing is planned.
+bool waitForNextSlot(int64_t* frameStartUs, uint8_t* band) {
+  int64_t nowUs = hal::wallUs();
+  time_t now = (time_t)(nowUs / 1000000);
+
+  time_t nextSlot = computeNextTxEpoch(now, band);
+  pushNextSlot(nextSlot, *band);
+  if (!nextSlot) {
+    Serial.println("Slot plan is empty — nothing to transmit.");
+    ledIdle();
+    serviceCommands(60000);
+    return false;
+  }
+  *frameStartUs = (int64_t)nextSlot * 1000000 + TX_START_OFFSET_US;
+  int64_t waitUs = max((int64_t)0, *frameStartUs - TX_PREP_LEAD_US - nowUs);
+  int waitSec = (int)(waitUs / 1000000);
 
   struct tm tNow, tSlot;
   gmtime_r(&now, &tNow);
   gmtime_r(&nextSlot, &tSlot);
 
-  Serial.printf(
+  logf(
     "UTC now: %02d:%02d:%02d | waiting %d sec\n",
     tNow.tm_hour, tNow.tm_min, tNow.tm_sec, waitSec
   );
 
-  Serial.printf(
-    "Next TX slot: %02d:%02d:00 | mode=%s\n\n",
-    tSlot.tm_hour, tSlot.tm_min,
+  logf(
+    "Next TX slot: %02d:%02d:00 | band %s | mode=%s\n\n",
+    tSlot.tm_hour, tSlot.tm_min, BANDS[*band].name,
     txEverySlot ? "EVERY" : "ALTERNATE"
   );
 
+  // Plan now, off the symbol path; a settings save during the wait comes
+  // back through here and plans again. A plan that isn't ready
+  // TX_PREP_LEAD_US ahead gives up the slot rather than start it late.
+  buildFramePlans(*band);
+  if (hal::wallUs() > *frameStartUs - TX_PREP_LEAD_US) framePlans[0].valid = false;
+  for (uint8_t k = 1; k < framePlanCount; k++) {
+    logf("  + CLK%u on %s\n", (unsigned)framePlans[k].clk, BANDS[framePlans[k].band].name);
+  }
+
   ledIdle();
-  serviceNetworkWhileWaiting((uint32_t)waitSec * 1000UL);
+  return serviceCommands((uint32_t)((waitUs + 999) / 1000));
 }
 
 // ---------- SET RF TONE ----------
-static inline void setTone(int tone) {
-  const double cal = bandCalHz[bandIndex];
-  double f = wsprBaseHz() + cal + sessionFreqOffsetHz + (tone * TONE_SPACING_HZ);
-  si5351.set_freq((uint64_t)(f * 100ULL), SI5351_CLK0);
+// Returns the number of I2C bytes put on the bus (register address included),
+// 0 if nothing changed or the write failed.
+static inline uint8_t setTone(const FramePlan& p, int tone) {
+  const uint8_t* img = p.tone[tone];
+  int first = -1, last = -1;
+  for (int j = 0; j < MS_REG_BYTES; j++) {
+    if (img[j] != msShadow[p.clk][j]) {
+      if (first < 0) first = j;
+      last = j;
+    }
+  }
+  if (first < 0) return 0;
+
+  const uint8_t n = (uint8_t)(last - first + 1);
+  uint8_t bytes = hal::radioWrite(hal::RADIO_MS_REG[p.clk] + first, &img[first], n);
+  metricBump(metrics.i2cWrites);
+  if (!bytes) {
+    metricBump(metrics.i2cErrors);   // shadow left stale: the next tone rewrites it
+    return 0;
+  }
+  memcpy(&msShadow[p.clk][first], &img[first], n);
+  return bytes;
+}
+
+// ---------- SYMBOL ENGINE ----------
+// Steps the 162 symbols of a frame from its own task so that nothing on the
+// network side (handleClient, DNS, a slow /scan) can delay a tone change.
+// The frame plans are latched when the engine is armed; settings saved
+// mid-frame apply from the next frame. Every output changes tone on the
+// same edge, CLK0 first.
+struct SymbolEngine {
+  int64_t startUs = 0;          // hal::monoUs() time of symbol 0 edge
+  const FramePlan* plans = nullptr;
+  uint8_t planCount = 0;
+  const uint8_t* symbols = nullptr;
+  volatile bool busy = false;
+  volatile int sent = 0;        // symbols keyed so far
+
+  // I2C cost of the tone changes; per-symbol stamps go to symTrace[].
+  uint32_t i2cBytes = 0;
+  uint32_t i2cUs = 0;
+};
+static SymbolEngine symEngine;
+
+// Runs on the HAL worker (core 1, top priority) once per frame.
+static void symbolFrame() {
+  SymbolEngine& e = symEngine;
+  e.i2cBytes = 0;
+  e.i2cUs = 0;
+
+  for (int i = 0; i < WSPR_SYMBOL_COUNT; i++) {
+    const int64_t targetUs = e.startUs + symbolEdgeUs(i);
+    hal::waitUntilUs(targetUs);
+
+    const int64_t enterUs = hal::monoUs();
+    for (uint8_t k = 0; k < e.planCount; k++) e.i2cBytes += setTone(e.plans[k], e.symbols[i]);
+    const int64_t doneUs = hal::monoUs();
+
+    SymbolStamp& st = symTrace[i];
+    st.targetUs = (int32_t)(targetUs - e.startUs);
+    st.enterUs = (int32_t)(enterUs - e.startUs);
+    st.doneUs = (int32_t)(doneUs - e.startUs);
+    e.i2cUs += (uint32_t)(doneUs - enterUs);
+    e.sent = i + 1;
+  }
+
+  // Hold the last tone for its full period before handing back.
+  hal::waitUntilUs(e.startUs + symbolEdgeUs(WSPR_SYMBOL_COUNT));
+  e.busy = false;
+}
+
+void startSymbolEngine() {
+  hal::workerStart(symbolFrame, "wspr_sym", 4096, SYMBOL_TASK_PRIO, SYMBOL_TASK_CORE);
 }
 
 // ---------- TRANSMIT FRAME ----------
-void transmitWSPR() {
+// One history record per output planned for the frame; timing is shared.
+static void historyAddOutputs(HistoryRecord& rec) {
+  for (uint8_t k = 0; k < framePlanCount; k++) {
+    const FramePlan& p = framePlans[k];
+    rec.clk = (uint8_t)p.clk;
+    rec.band = (uint8_t)p.band;
+    rec.carrierCentiHz = (p.carrierQ + 128) / 256;   // FREQ_Q is centi-Hz * 256
+    rec.scatterHz = (int16_t)p.scatterHz;
+    historyAdd(rec);
+  }
+}
+
+// Set once a tx_disabled record is in the history: the slots skipped after
+// it are only counted, not logged, until TX is on again.
+static bool txOffLogged = false;
+
+// frameStartUs: UTC microseconds at which symbol 0 must begin.
+void transmitWSPR(int64_t frameStartUs, uint8_t band) {
+  HistoryRecord rec = {};
+  rec.startEpoch = (uint32_t)(frameStartUs / 1000000);
+  rec.band = band;
+  rec.msgType = msgSeq[msgFrames % msgSeqLen]->type;
+
   if (!txEnabled) {
     Serial.println("TX disabled — skipping transmit.");
+    if (txOffLogged) {
+      metricBump(metrics.frames[(uint8_t)HistAbort::TxDisabled]);
+      return;
+    }
+    rec.abort = (uint8_t)HistAbort::TxDisabled;
+    historyAdd(rec);
+    txOffLogged = true;
     return;
   }
+  txOffLogged = false;
   if (!timeValid()) {
     Serial.println("Time not valid — skipping transmit.");
+    rec.abort = (uint8_t)HistAbort::TimeInvalid;
+    historyAdd(rec);
+    return;
+  }
+  if (!framePlans[0].valid || framePlans[0].band != band) {
+    Serial.println("Frame plan not ready in time — skipping transmit.");
+    rec.abort = (uint8_t)HistAbort::MissedStart;
+    historyAdd(rec);
     return;
   }
 
-  sessionFreqOffsetHz = random(0, 100);
-
-  const double cal = bandCalHz[bandIndex];
-  double carrier = wsprBaseHz() + cal + sessionFreqOffsetHz;
-
-  Serial.printf("Band: %s  Dial: %.4f MHz\n",
-                BANDS[bandIndex].name, BANDS[bandIndex].dial_hz / 1e6);
-  Serial.printf("Carrier: %.6f MHz  (band cal %+0.1f Hz, scatter %+0.1f Hz)\n",
-                carrier / 1e6, cal, sessionFreqOffsetHz);
-
-  Serial.println("Encoding WSPR...");
-  jt.wspr_encode(CALLSIGN.c_str(), LOCATOR.c_str(), POWER_DBM, symbols);
-
-  time_t tStart; time(&tStart);
-  struct tm ts; gmtime_r(&tStart, &ts);
-  Serial.printf("TX START  UTC %02d:%02d:%02d  | expected ~110.6 s\n",
-                ts.tm_hour, ts.tm_min, ts.tm_sec);
-
-  rfOn();
-
-  const uint32_t t0ms = millis();
-  const uint32_t startUs = micros();
-
-  for (int i = 0; i < 162; i++) {
-    setTone(symbols[i]);
-
-    // Target time for end of this symbol
-    const uint32_t targetUs = startUs + (uint32_t)(i + 1) * SYMBOL_PERIOD_US;
+  const FramePlan& plan = framePlans[0];
+  sessionFreqOffsetHz = plan.scatterHz;
+
+  hal::RadioClk clks[TX_OUTPUTS];
+  for (uint8_t k = 0; k < framePlanCount; k++) {
+    const FramePlan& p = framePlans[k];
+    clks[k] = p.clk;
+    logf("CLK%u  Band: %s  Dial: %.4f MHz\n",
+         (unsigned)p.clk, BANDS[p.band].name, BANDS[p.band].dial_chz / 1e8);
+    logf("      Carrier: %.6f MHz  (cal %+0.2f Hz, scatter %+d Hz)\n",
+         p.carrierQ / (1e6 * FREQ_Q_PER_HZ), p.calCentiHz / 100.0,
+         (int)p.scatterHz);
+  }
 
-    // Keep web responsive, but don't extend symbol time beyond target.
-    while ((int32_t)(micros() - targetUs) < 0) {
-      server.handleClient();
-      if (captivePortalActive) dnsServer.processNextRequest();
-      delay(1);
+  // Already encoded; a save since the last frame re-encoded on the spot.
+  const WsprMessage& msg = *msgSeq[msgFrames % msgSeqLen];
+  logf("Message: Type %u  %s %s %u dBm\n",
+       msg.type, msg.call, msg.type == 2 ? "" : msg.loc, msg.pwr);
+
+  primeFramePlans(msg.symbols[0]);
+
+  // Map the UTC start onto the monotonic clock the engine runs on. The wall
+  // clock is read between two monotonic reads to bound the pairing error.
+  int64_t m0 = hal::monoUs();
+  int64_t wallAtMap = hal::wallUs();
+  int64_t monoAtMap = (m0 + hal::monoUs()) / 2;
+  int64_t startUs = monoAtMap + (frameStartUs - wallAtMap);
+  int64_t earliestUs = hal::monoUs() + SYMBOL_START_LEAD_US;
+  if (startUs < earliestUs) {
+    if (earliestUs - startUs > TX_MAX_LATE_US) {
+      logf("Missed frame start by %lld ms — skipping transmit.\n",
+           (long long)((earliestUs - startUs) / 1000));
+      framePlans[0].valid = false;
+      rec.startErrUs = (int32_t)min(earliestUs - startUs, (int64_t)INT32_MAX);
+      rec.abort = (uint8_t)HistAbort::MissedStart;
+      historyAddOutputs(rec);
+      return;
     }
+    startUs = earliestUs;   // prep overran: go as soon as possible
   }
 
+  time_t tStart = (time_t)(frameStartUs / 1000000);
+  struct tm ts; gmtime_r(&tStart, &ts);
+  logf("TX START  UTC %02d:%02d:%02d  | expected ~110.6 s\n",
+       ts.tm_hour, ts.tm_min, ts.tm_sec);
+
+  // Coarse sleep, key up just ahead of the edge, then the engine's
+  // precise wait lands symbol 0.
+  int64_t keyInUs = startUs - SYMBOL_START_LEAD_US - hal::monoUs();
+  if (keyInUs >= 1000) hal::sleepMs((uint32_t)(keyInUs / 1000));
+  rfOn(clks, framePlanCount);
+
+  const uint32_t t0ms = hal::monoMs();
+
+  // Arm the engine; from here on symbol timing is owned by symbolFrame().
+  symEngine.plans = framePlans;
+  symEngine.planCount = framePlanCount;
+  symEngine.symbols = msg.symbols;
+  symEngine.sent = 0;
+  symEngine.busy = true;
+  symEngine.startUs = startUs;
+  hal::workerKick();
+
+  for (uint8_t k = 0; k < framePlanCount; k++) txNow.bands[k] = (uint8_t)framePlans[k].band;
+  txNow.outputs = framePlanCount;
+  txNow.type = msg.type;
+  txNow.startEpoch = (uint32_t)tStart;
+  txNow.on = true;
+  pushTx(0);
+
+  // Block until the engine is done, reporting progress once a second; web
+  // and DNS are served on core 0 and commands queue up until after the frame.
+  while (!hal::workerWait(1000)) pushTx(symEngine.sent);
+
   rfOff();
+  txNow.on = false;
+  framePlans[0].valid = false;
+  msgFrames++;
+
+  float elapsed = (hal::monoMs() - t0ms) / 1000.0f;
+  logf("TX COMPLETE — actual %.2f s\n", elapsed);
+  // Where symbol 0 really began, on the UTC clock, against where it should.
+  int64_t startErrUs = (startUs + symTrace[0].enterUs) + (wallAtMap - monoAtMap) - frameStartUs;
+  const FrameTiming& ft = recordFrameTiming((uint32_t)tStart, (uint8_t)plan.band,
+                                            symEngine.i2cBytes, startErrUs);
+  pushTx(symEngine.sent, &startErrUs);
+  rec.startErrUs = ft.startErrUs;
+  rec.edgeP50Us = ft.edgeP50Us;
+  rec.edgeP99Us = ft.edgeP99Us;
+  rec.edgeMaxUs = ft.edgeMaxUs;
+  rec.writeMaxUs = ft.writeMaxUs;
+  rec.i2cBytes = (uint16_t)min(symEngine.i2cBytes, (uint32_t)UINT16_MAX);
+  rec.symbols = (uint16_t)symEngine.sent;
+  historyAddOutputs(rec);
+  logf("Frame start error: %+lld us\n", (long long)startErrUs);
+  logf("Symbol edges: min %ld / p50 %ld / p99 %ld / max %ld us, tone write max %ld us\n",
+       (long)ft.edgeMinUs, (long)ft.edgeP50Us, (long)ft.edgeP99Us,
+       (long)ft.edgeMaxUs, (long)ft.writeMaxUs);
+  logf("I2C: %lu bytes (%.2f/symbol), %lu us (%.1f us/symbol)\n\n",
+       (unsigned long)symEngine.i2cBytes,
+       symEngine.i2cBytes / (float)WSPR_SYMBOL_COUNT,
+       (unsigned long)symEngine.i2cUs,
+       symEngine.i2cUs / (float)WSPR_SYMBOL_COUNT);
+}
 
-  float elapsed = (millis() - t0ms) / 1000.0f;
-  Serial.printf("TX COMPLETE — actual %.2f s\n\n", elapsed);
+// ---------- LED PATTERNS ----------
+// Runs on the LED task and only reads beacon state. Idle shows what the
+// beacon is waiting for, in priority order:
+//   AP mode, no station link   magenta double blink
+//   waiting for time (NTP)     blue 1 Hz blink
+//   ready                      steady green
+// During a frame the pixel is red, warming to amber as symbols go out.
+static hal::Rgb ledPattern(uint32_t nowMs) {
+  if (ledMode == LedMode::Off) return { 0, 0, 0 };
+  if (ledMode == LedMode::Tx) {
+    return { 20, (uint8_t)(symEngine.sent * 12 / WSPR_SYMBOL_COUNT), 0 };
+  }
+  if (captivePortalActive && !hal::wifiStaConnected()) {
+    uint32_t ph = nowMs % 1200;
+    bool on = ph < 100 || (ph >= 250 && ph < 350);
+    return on ? hal::Rgb{ 16, 0, 16 } : hal::Rgb{ 0, 0, 0 };
+  }
+  if (!timeValid()) {
+    return (nowMs % 1000) < 500 ? hal::Rgb{ 0, 0, 20 } : hal::Rgb{ 0, 0, 0 };
+  }
+  return { 0, 20, 0 };
 }
 
 // ---------- SETUP ----------
 void setup() {
   Serial.begin(115200);
-  delay(800);
+  hal::sleepMs(800);
 
-  rgb.begin();
-  rgb.clear();
-  rgb.show();
+  hal::ledInit();
   ledOff();
+  hal::ledStart(ledPattern, LED_PERIOD_MS);
 
   loadSettings();
+  historyBegin();
+  powerBegin();
+  rebuildDayPlan();
+  rebuildMessages();
+  cmdQueue = hal::queueCreate(sizeof(Command), CMD_QUEUE_DEPTH);
 
   Serial.println("\nESP32 + Si5351 WSPR Beacon (web-configurable)");
-  Serial.printf("Callsign %s  Locator %s  Power %u dBm\n",
-                CALLSIGN.c_str(), LOCATOR.c_str(), POWER_DBM);
-  Serial.printf("Active band: %s\n", BANDS[bandIndex].name);
-  Serial.printf("TX enabled: %s  | Slot mode: %s\n",
-                txEnabled ? "YES" : "NO",
-                txEverySlot ? "EVERY" : "ALTERNATE");
-  Serial.printf("NTP server: %s\n", ntpServer.c_str());
-
-  Wire.begin(8, 9);
-
-  // Serial.println("Init Si5351...");
-  // si5351.init(SI5351_CRYSTAL_LOAD_8PF, SI5351_CRYSTAL, 0);
-  // si5351.drive_strength(SI5351_CLK0, SI5351_DRIVE_8MA);
-  // rfOff();
-
-Serial.println("Init Si5351...");
-
-// HARD mute outputs immediately
-si5351.output_enable(SI5351_CLK0, 0);
-si5351.output_enable(SI5351_CLK1, 0);
-si5351.output_enable(SI5351_CLK2, 0);
-
-// Now initialise the chip
-si5351.init(SI5351_CRYSTAL_LOAD_8PF, SI5351_CRYSTAL, 0);
-
-// Optional but recommended: reset PLLs
-si5351.pll_reset(SI5351_PLLA);
-si5351.pll_reset(SI5351_PLLB);
-
-// Set drive strength while still muted
-si5351.drive_strength(SI5351_CLK0, SI5351_DRIVE_8MA);
-
-// Ensure frequency is zeroed
-si5351.set_freq(0, SI5351_CLK0);
-
-// Final safety mute
-rfOff();
-
-
+  logf("Callsign %s  Locator %s  Power %u dBm\n",
+       CALLSIGN, LOCATOR, POWER_DBM);
+  logf("Active band: %s\n", BANDS[bandIndex].name);
+  logf("TX enabled: %s  | Slot mode: %s\n",
+       txEnabled ? "YES" : "NO",
+       txEverySlot ? "EVERY" : "ALTERNATE");
+  logf("NTP server: %s\n", ntpServer);
+
+  Serial.println("Init Si5351...");
+  hal::radioInit();
+
+  // Final safety mute
+  rfOff();
 
+  randomSeed(hal::hwRandom());
 
-  randomSeed((uint32_t)esp_random());
+  startSymbolEngine();
 
-  // Try STA for 30 seconds, else AP + captive portal
-  bool staOk = connectStaWithTimeout(30000);
-  if (!staOk) {
-    startApModeCaptivePortal();
-  }
+  // Nothing below waits for the network: the first association (or the AP,
+  // with no SSID stored) starts here and the web server right after it.
+  // WiFi and NTP run in the background from here on (see wifiService()).
+  wifiKick();
+  wifiService();
 
   // mDNS is most useful on STA
-  if (MDNS.begin(HOSTNAME)) {
-    MDNS.addService("http", "tcp", 80);
-    Serial.printf("mDNS started: http://%s.local/\n", HOSTNAME);
+  if (hal::mdnsBegin(HOSTNAME)) {
+    logf("mDNS started: http://%s.local/\n", HOSTNAME);
   } else {
     Serial.println("mDNS failed to start");
   }
 
   startWeb();
 
-  // NTP if possible
-  if (staOk) {
-    syncNtpTime();
-  }
-
-  Serial.println("Ready\n");
+  logf("Ready after %lu ms\n\n", (unsigned long)hal::monoMs());
 }
 
 // ---------- LOOP ----------
 void loop() {
-  // Keep portal responsive all the time
-  server.handleClient();
-  if (captivePortalActive) dnsServer.processNextRequest();
-
-  // Periodic STA retry if in AP mode and credentials exist
-  static uint32_t lastStaTry = 0;
-  if (WiFi.status() != WL_CONNECTED && !wifiSsid.isEmpty()) {
-    if (millis() - lastStaTry > 180000UL) { // every 3 minutes
-      lastStaTry = millis();
-      Serial.println("Periodic STA retry...");
-      bool ok = connectStaWithTimeout(15000);
-      if (ok) {
-        syncNtpTime();
-      }
-    }
-  }
-
-  // If time not valid, try NTP periodically when connected
+  // No valid time yet: keep serving commands; NTP retries on its own backoff.
   if (!timeValid()) {
-    static uint32_t lastNtpTry = 0;
-    if (WiFi.status() == WL_CONNECTED && millis() - lastNtpTry > 30000UL) {
-      lastNtpTry = millis();
-      syncNtpTime();
-    }
-    delay(50);
+    serviceCommands(1000);
     return;
   }
 
-  waitForNextSlot();
-  transmitWSPR();
+  int64_t frameStartUs;
+  uint8_t band;
+  if (waitForNextSlot(&frameStartUs, &band)) {
+    powerFull(true);
+    transmitWSPR(frameStartUs, band);
+    powerFull(false);
+  }
+  historyService();
 }
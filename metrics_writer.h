@@ -0,0 +1,96 @@
+// Streaming Prometheus text-format (0.0.4) writer over a caller-owned fixed
+// buffer; the /metrics counterpart of JsonWriter, with the same sink.
+//
+//   MetricsWriter m(buf, sizeof(buf), hal::httpSendChunk);
+//   m.family("wspr_frames_total", "counter", "Frames by outcome.");
+//   m.sample("wspr_frames_total", 42, "outcome", "sent");
+//   m.seconds("wspr_frame_start_error_seconds", -120);   // from microseconds
+//   m.finish();
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class MetricsWriter {
+public:
+  typedef void (*Sink)(const char* data, size_t len);
+
+  MetricsWriter(char* buf, size_t cap, Sink sink) : buf_(buf), cap_(cap), sink_(sink) {}
+
+  // # HELP / # TYPE header; samples of the family follow.
+  void family(const char* name, const char* type, const char* help) {
+    raw("# HELP "); raw(name); put(' '); raw(help); put('\n');
+    raw("# TYPE "); raw(name); put(' '); raw(type); put('\n');
+  }
+
+  void sample(const char* name, long long v, const char* label = nullptr, const char* labelValue = nullptr) {
+    head(name, label, labelValue);
+    num(v);
+    put('\n');
+  }
+
+  // A microsecond count written in seconds, the Prometheus base unit.
+  void seconds(const char* name, long long us, const char* label = nullptr, const char* labelValue = nullptr) {
+    head(name, label, labelValue);
+    if (us < 0) put('-');
+    uint64_t a = us < 0 ? 0 - (unsigned long long)us : (uint64_t)us;
+    unum(a / 1000000);
+    put('.');
+    unum(a % 1000000, 6);
+    put('\n');
+  }
+
+  // family() + one unlabelled sample.
+  void metric(const char* name, const char* type, const char* help, long long v) {
+    family(name, type, help);
+    sample(name, v);
+  }
+
+  void finish() {
+    if (len_) sink_(buf_, len_);
+    len_ = 0;
+  }
+
+private:
+  void put(char c) {
+    if (len_ == cap_) finish();
+    buf_[len_++] = c;
+  }
+
+  void raw(const char* s) {
+    while (*s) put(*s++);
+  }
+
+  void head(const char* name, const char* label, const char* labelValue) {
+    raw(name);
+    if (label) {
+      put('{');
+      raw(label);
+      raw("=\"");
+      for (const char* s = labelValue; s && *s; s++) {
+        if (*s == '\\' || *s == '"') put('\\');
+        if (*s == '\n') { raw("\\n"); continue; }
+        put(*s);
+      }
+      raw("\"}");
+    }
+    put(' ');
+  }
+
+  void unum(uint64_t v, uint8_t minDigits = 1) {
+    char tmp[21];
+    uint8_t n = 0;
+    do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v || n < minDigits);
+    while (n) put(tmp[--n]);
+  }
+
+  void num(long long v) {
+    if (v < 0) { put('-'); unum(0 - (unsigned long long)v); }
+    else unum((uint64_t)v);
+  }
+
+  char* buf_;
+  size_t cap_;
+  size_t len_ = 0;
+  Sink sink_;
+};
@@ -0,0 +1,132 @@
+// Minimal Arduino core for the native (Linux host) build.
+//
+// Only what main.cpp and JTEncode use: String, Serial, random() and the
+// PROGMEM helpers. Clocks, radio, WiFi and the rest live behind hal.h.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// newlib has strlcpy; glibc only since 2.38.
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = 0;
+  }
+  return len;
+}
+#endif
+
+#define PROGMEM
+#define PGM_P const char*
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+// ---------- String ----------
+class String {
+public:
+  String(const char* s = "") : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c) : s_(1, c) {}
+  String(int v)           { fmt("%d", v); }
+  String(unsigned v)      { fmt("%u", v); }
+  String(long v)          { fmt("%ld", v); }
+  String(unsigned long v) { fmt("%lu", v); }
+  String(double v, unsigned int decimals = 2) { fmt("%.*f", (int)decimals, v); }
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o)   { s_ += (o ? o : ""); return *this; }
+  String& operator+=(char c)          { s_ += c; return *this; }
+
+  friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String& a, const char* b)   { return String(a.s_ + (b ? b : "")); }
+  friend String operator+(const char* a, const String& b)   { return String((a ? a : "") + b.s_); }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* o) const   { return s_ == (o ? o : ""); }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator!=(const char* o) const   { return !(*this == o); }
+  char operator[](size_t i) const { return i < s_.size() ? s_[i] : 0; }
+  char& operator[](size_t i)      { return s_[i]; }
+
+  size_t length() const     { return s_.size(); }
+  bool isEmpty() const      { return s_.empty(); }
+  const char* c_str() const { return s_.c_str(); }
+  void reserve(size_t n)    { s_.reserve(n); }
+
+  void trim() {
+    size_t a = 0, b = s_.size();
+    while (a < b && isspace((unsigned char)s_[a])) a++;
+    while (b > a && isspace((unsigned char)s_[b - 1])) b--;
+    s_ = s_.substr(a, b - a);
+  }
+  void toUpperCase() { for (auto& c : s_) c = (char)toupper((unsigned char)c); }
+  long toInt() const      { return strtol(s_.c_str(), nullptr, 10); }
+  double toDouble() const { return strtod(s_.c_str(), nullptr); }
+  float toFloat() const   { return (float)toDouble(); }
+
+  void replace(const String& from, const String& to) {
+    if (from.s_.empty()) return;
+    size_t pos = 0;
+    while ((pos = s_.find(from.s_, pos)) != std::string::npos) {
+      s_.replace(pos, from.s_.size(), to.s_);
+      pos += to.s_.size();
+    }
+  }
+
+private:
+  void fmt(const char* f, ...) {
+    char buf[64];
+    va_list ap;
+    va_start(ap, f);
+    vsnprintf(buf, sizeof(buf), f, ap);
+    va_end(ap);
+    s_ = buf;
+  }
+  std::string s_;
+};
+
+// ---------- Serial ----------
+class HostSerial {
+public:
+  bool quiet = false;
+  void begin(unsigned long) {}
+  size_t printf(const char* f, ...) __attribute__((format(printf, 2, 3))) {
+    if (quiet) return 0;
+    va_list ap;
+    va_start(ap, f);
+    int n = vprintf(f, ap);
+    va_end(ap);
+    return n > 0 ? (size_t)n : 0;
+  }
+  size_t write(const char* s, size_t n) { return quiet ? 0 : fwrite(s, 1, n, stdout); }
+  size_t print(const char* s)      { return quiet ? 0 : (size_t)fputs(s, stdout); }
+  size_t print(const String& s)    { return print(s.c_str()); }
+  size_t println(const char* s = "") { if (quiet) return 0; fputs(s, stdout); fputc('\n', stdout); return strlen(s) + 1; }
+  size_t println(const String& s)  { return println(s.c_str()); }
+};
+extern HostSerial Serial;
+
+// ---------- random ----------
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
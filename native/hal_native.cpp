@@ -0,0 +1,907 @@
+// Native (Linux host) backend for hal.h: virtual clock, recording Si5351,
+// scripted WiFi/NTP, in-memory NVS and an in-process HTTP router.
+#ifndef ARDUINO
+
+#include "hal_native.h"
+
+#include <deque>
+#include <random>
+
+HostSerial Serial;
+
+// ---------- random ----------
+static std::mt19937 rng(1);
+
+long random(long howBig) {
+  if (howBig <= 0) return 0;
+  return (long)(rng() % (unsigned long)howBig);
+}
+
+long random(long howSmall, long howBig) {
+  if (howSmall >= howBig) return howSmall;
+  return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed) {
+  rng.seed((uint32_t)seed);
+}
+
+// ---------- STATE ----------
+namespace {
+
+int64_t nowUs = 0;
+uint32_t wakeLatencyUs = 0;
+std::mt19937 latencyRng(1);             // own stream: the sketch's random() is untouched
+
+const time_t epochAtSync = 1767225600;   // 2026-01-01 00:00:00 UTC
+const uint32_t ntpDelayMs = 40;          // round trip of a fake SNTP exchange
+bool ntpReachable = true;
+const uint32_t NTP_TIMEOUT_MS = 3000;
+int64_t wallOffsetUs = 0;                // wall clock = nowUs + wallOffsetUs
+int64_t trueRefUs = -1;                  // nowUs at which true time was epochAtSync
+int64_t ntpDueUs = -1;                   // pending exchange completes here
+bool ntpPendingOk = false;
+hal::NtpDone ntpPendingDone = nullptr;
+
+bool staReachable = false;
+const uint32_t staConnectDelayMs = 2000;
+const uint32_t staCachedConnectDelayMs = 300;  // BSSID + channel given: no scan
+const uint8_t STA_BSSID[6] = { 0x02, 0x57, 0x53, 0x50, 0x52, 0x01 };
+const uint8_t STA_CHANNEL = 6;
+const uint8_t REASON_NO_AP_FOUND = 201;
+const uint8_t REASON_BEACON_TIMEOUT = 200;
+bool staUp = false;
+int64_t staEventUs = -1;                 // pending link event fires here
+hal::WifiLink staPendingLink = {};
+hal::WifiLinkFn staLinkFn = nullptr;
+char staIpText[16] = "192.168.1.50";
+bool apUp = false;
+
+struct ScanEntry { std::string ssid; int32_t rssi; };
+std::vector<ScanEntry> scanResults;
+
+struct NativeQueue {
+  size_t itemSize;
+  size_t depth;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+hal::WorkerFn workerFn = nullptr;
+bool workerDone = false;
+
+uint8_t regs[256];
+bool clkEnabled[3];
+uint32_t clkKeyed[3];
+std::vector<native::RadioWrite> writes;
+uint32_t busBytes = 0;
+uint32_t radioFailures = 0;              // next radioWrite() calls to NAK
+std::vector<native::TxRecord> txs;
+
+int64_t powerHeldSinceUs = -1;
+int64_t powerHeldTotalUs = 0;
+// The device's precise waits spin on the timer for their last stretch;
+// that is the busy time the tick meter sees, averaged over CPU_CORES.
+const int64_t CPU_CORES = 2;
+bool cpuMeterOn = false;
+int64_t spinUs = 0;
+
+hal::Rgb led = { 0, 0, 0 };
+hal::LedPattern ledPattern = nullptr;
+uint32_t ledPeriodMs = 50;
+int64_t ledDueUs = -1;
+
+typedef std::map<std::string, std::string> KvNamespace;
+std::map<std::string, KvNamespace> kvStore;
+KvNamespace* kvOpen = nullptr;
+uint32_t kvBlobWrites = 0;
+
+std::map<std::string, std::string> files;
+
+struct Route { std::string uri; hal::HttpMethod method; hal::HttpHandler handler; };
+std::vector<Route> routes;
+hal::HttpHandler notFound = nullptr;
+const std::map<std::string, std::string>* reqArgs = nullptr;
+const std::map<std::string, std::string>* reqHeaders = nullptr;
+const char* reqBody = nullptr;
+native::HttpResponse* resp = nullptr;
+int64_t firstResponseUs = 0;
+
+struct ScriptAction { int64_t atUs; uint32_t seq; std::function<void()> fn; };
+std::vector<ScriptAction> script;        // sorted by (atUs, seq)
+uint32_t scriptSeq = 0;
+
+// Push events as on the device: the beacon copies each into a fixed ring
+// and the network task empties it on the streams' 500 ms poll.
+const int64_t EVENTS_POLL_US = 500000;
+const size_t EVENTS_RING = 16;   // as hal_esp32.cpp
+struct EventMsg {
+  uint32_t id;
+  char event[12];
+  char data[hal::EVENTS_DATA_MAX];
+};
+NativeQueue* eventRing = nullptr;
+int64_t eventsPollUs = -1;               // next poll while a stream is open
+uint8_t eventClients = 0;
+std::vector<native::PushEvent> pushed;
+
+// Heap accounting: who a malloc is charged to, as the device would see it.
+// The mock's own bookkeeping (recorded writes, responses, the fake NVS)
+// has no counterpart on the device and runs under HalHeap, uncounted.
+enum AllocCtx : uint8_t { ALLOC_BEACON, ALLOC_ENGINE, ALLOC_OTHER };
+AllocCtx allocCtx = ALLOC_BEACON;
+uint32_t halDepth = 0;
+hal::AllocCounts allocs = { 0, 0, 0 };
+// Flash calls by the same contexts: each opens a LittleFS file or an NVS
+// handle, which allocates on the device (hal.h exempts them).
+hal::AllocCounts fileOps = { 0, 0, 0 };
+hal::AllocCounts nvsOpens = { 0, 0, 0 };
+
+struct HalHeap {
+  HalHeap()  { halDepth++; }
+  ~HalHeap() { halDepth--; }
+};
+
+struct AllocAs {
+  AllocCtx saved;
+  explicit AllocAs(AllocCtx c) : saved(allocCtx) { allocCtx = c; }
+  ~AllocAs() { allocCtx = saved; }
+};
+
+void charge(hal::AllocCounts& c) {
+  if (halDepth) return;
+  switch (allocCtx) {
+    case ALLOC_BEACON: c.beacon++; break;
+    case ALLOC_ENGINE: c.engine++; break;
+    default:           c.other++;  break;
+  }
+}
+
+void countAlloc() {
+  charge(allocs);
+}
+
+void pumpLinkEvent() {
+  if (staEventUs < 0 || nowUs < staEventUs) return;
+  staEventUs = -1;
+  staUp = staPendingLink.up;
+  staLinkFn(staPendingLink);
+}
+
+// The LED task: renders at its period from wherever the clock moves, the
+// symbol engine's waits included, as the real task would on core 0.
+void pumpLed() {
+  if (ledDueUs < 0 || nowUs < ledDueUs) return;
+  ledDueUs = nowUs + (int64_t)ledPeriodMs * 1000;
+  hal::Rgb c = ledPattern((uint32_t)(nowUs / 1000));
+  led = c;
+}
+
+void pumpScript() {
+  HalHeap heap;
+  while (!script.empty() && script.front().atUs <= nowUs) {
+    std::function<void()> fn = script.front().fn;
+    script.erase(script.begin());
+    fn();
+  }
+}
+
+void pumpEventRing() {
+  if (!eventRing || eventsPollUs < 0 || nowUs < eventsPollUs) return;
+  HalHeap heap;
+  eventsPollUs = nowUs + EVENTS_POLL_US;
+  while (!eventRing->items.empty()) {
+    const EventMsg* m = (const EventMsg*)eventRing->items.front().data();
+    pushed.push_back({ nowUs, m->event, m->data, m->id });
+    eventRing->items.pop_front();
+  }
+}
+
+// Background completions (the fake NTP and WiFi tasks, script actions)
+// fire once the virtual clock reaches them, from whatever call moved it there.
+void pumpEvents() {
+  pumpLed();
+  pumpScript();
+  pumpLinkEvent();
+  pumpEventRing();
+  if (ntpDueUs < 0 || nowUs < ntpDueUs) return;
+  ntpDueUs = -1;
+  hal::NtpResult r = {};
+  r.ok = ntpPendingOk;
+  if (r.ok) {
+    if (trueRefUs < 0) trueRefUs = nowUs;
+    r.offsetUs = native::trueUs() - (nowUs + wallOffsetUs);
+    r.rttUs = ntpDelayMs * 1000;
+    wallOffsetUs += r.offsetUs;
+  }
+  ntpPendingDone(r);
+}
+
+// Earliest pending background event at or before limitUs.
+int64_t nextEventUs(int64_t limitUs) {
+  int64_t nextUs = limitUs;
+  if (ntpDueUs >= 0 && ntpDueUs < nextUs) nextUs = ntpDueUs;
+  if (staEventUs >= 0 && staEventUs < nextUs) nextUs = staEventUs;
+  if (!script.empty() && script.front().atUs < nextUs) nextUs = script.front().atUs;
+  if (eventsPollUs >= 0 && eventsPollUs < nextUs) nextUs = eventsPollUs;
+  return nextUs;
+}
+
+// Moves the clock to targetUs, stopping at every event on the way.
+void advanceTo(int64_t targetUs) {
+  while (nowUs < targetUs) {
+    nowUs = max(nowUs, nextEventUs(targetUs));
+    pumpEvents();
+  }
+}
+
+void recordWrite(uint8_t reg, uint8_t len) {
+  HalHeap heap;
+  writes.push_back({ nowUs, reg, len });
+  busBytes += len + 1;
+}
+
+} // namespace
+
+// glibc lets a program replace malloc and friends; these count, then hand
+// over to the real allocator (free is left alone: it needs no count).
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+void* malloc(size_t size) {
+  countAlloc();
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+  countAlloc();
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+  countAlloc();
+  return __libc_realloc(p, size);
+}
+}
+#endif
+
+// ---------- CONTROLS ----------
+namespace native {
+
+void setNtpReachable(bool ok)         { ntpReachable = ok; }
+void setWakeLatencyUs(uint32_t us)    { wakeLatencyUs = us; }
+void stepWall(int64_t deltaUs)       { wallOffsetUs += deltaUs; }
+
+int64_t trueUs() {
+  return trueRefUs < 0 ? -1 : (int64_t)epochAtSync * 1000000 + (nowUs - trueRefUs);
+}
+
+void at(int64_t monoUs, std::function<void()> action) {
+  HalHeap heap;
+  ScriptAction a = { monoUs, scriptSeq++, action };
+  auto pos = script.begin();
+  while (pos != script.end() && pos->atUs <= monoUs) ++pos;
+  script.insert(pos, a);
+}
+
+void setStaReachable(bool ok)         { staReachable = ok; }
+
+void dropSta() {
+  if (!staUp) return;
+  staPendingLink = {};
+  staPendingLink.reason = REASON_BEACON_TIMEOUT;
+  staEventUs = nowUs;
+  pumpEvents();
+}
+void addScanResult(const char* ssid, int32_t rssi) { scanResults.push_back({ ssid, rssi }); }
+
+const std::vector<RadioWrite>& radioWrites() { return writes; }
+bool radioEnabled(hal::RadioClk clk)         { return clkEnabled[clk]; }
+uint32_t radioKeyCount(hal::RadioClk clk)    { return clkKeyed[clk]; }
+uint32_t radioBusBytes()                     { return busBytes; }
+void failRadioWrites(uint32_t n)             { radioFailures = n; }
+const std::vector<TxRecord>& txLog()         { return txs; }
+
+int64_t powerHeldUs() {
+  return powerHeldTotalUs + (powerHeldSinceUs >= 0 ? nowUs - powerHeldSinceUs : 0);
+}
+hal::Rgb ledColor()                          { return led; }
+
+double radioFreqHz(hal::RadioClk clk) {
+  const uint8_t* m = &regs[hal::RADIO_MS_REG[clk]];
+  uint32_t p3 = ((uint32_t)(m[5] & 0xF0) << 12) | ((uint32_t)m[0] << 8) | m[1];
+  uint32_t p1 = ((uint32_t)(m[2] & 0x03) << 16) | ((uint32_t)m[3] << 8) | m[4];
+  uint32_t p2 = ((uint32_t)(m[5] & 0x0F) << 16) | ((uint32_t)m[6] << 8) | m[7];
+  if (p3 == 0) return 0.0;
+  double div = (p1 + 512.0 + (double)p2 / p3) / 128.0;
+  return (double)hal::RADIO_PLL_HZ / div;
+}
+
+void kvSeed(const char* ns, const char* key, const std::string& value) {
+  kvStore[ns][key] = value;
+}
+
+uint32_t kvBlobWriteCount() {
+  return kvBlobWrites;
+}
+
+hal::AllocCounts flashFileOps()              { return fileOps; }
+hal::AllocCounts flashNvsOpens()             { return nvsOpens; }
+
+void setEventClients(uint8_t n) {
+  if (eventRing && n && !eventClients) eventRing->items.clear();   // nobody heard these
+  eventClients = n;
+  eventsPollUs = n ? nowUs + EVENTS_POLL_US : -1;
+}
+const std::vector<PushEvent>& events()         { return pushed; }
+
+HttpResponse httpRequest(const char* method, const char* uri,
+                         const std::map<std::string, std::string>& args,
+                         const std::map<std::string, std::string>& headers,
+                         const char* body) {
+  HalHeap heap;
+  HttpResponse r;
+  hal::HttpMethod m = strcmp(method, "POST") == 0 ? hal::HttpMethod::Post
+                    : strcmp(method, "PUT") == 0  ? hal::HttpMethod::Put : hal::HttpMethod::Get;
+  hal::HttpHandler h = notFound;
+  for (const Route& rt : routes) {
+    if (rt.uri == uri && (rt.method == hal::HttpMethod::Any || rt.method == m)) {
+      h = rt.handler;
+      break;
+    }
+  }
+  reqArgs = &args;
+  reqHeaders = &headers;
+  reqBody = body && strlen(body) <= hal::HTTP_BODY_MAX ? body : nullptr;
+  resp = &r;
+  {
+    // The handler runs as the web task would, outside the mock's bookkeeping.
+    uint32_t depth = halDepth;
+    halDepth = 0;
+    AllocAs web(ALLOC_OTHER);
+    if (h) h(); else r.code = 404;
+    halDepth = depth;
+  }
+  if (!firstResponseUs) firstResponseUs = nowUs;
+  reqArgs = nullptr;
+  reqHeaders = nullptr;
+  reqBody = nullptr;
+  resp = nullptr;
+  return r;
+}
+
+} // namespace native
+
+namespace hal {
+
+// ---------- CLOCK ----------
+int64_t monoUs() {
+  return nowUs;
+}
+
+void sleepMs(uint32_t ms) {
+  advanceTo(nowUs + (int64_t)ms * 1000);
+}
+
+// The loop of hal_esp32.cpp: 1 ms ticks until WAIT_SPIN_US out, each
+// wake-up up to wakeLatencyUs late (preempted before the spin), then spin.
+void waitUntilUs(int64_t targetUs) {
+  for (;;) {
+    int64_t remain = targetUs - nowUs;
+    if (remain <= 0) break;
+    if (remain > WAIT_SPIN_US) {
+      int64_t ms = (remain - WAIT_SPIN_US) / 1000;
+      advanceTo(nowUs + max(ms, (int64_t)1) * 1000);
+      if (wakeLatencyUs) advanceTo(nowUs + latencyRng() % (wakeLatencyUs + 1));
+      continue;
+    }
+    if (cpuMeterOn) spinUs += remain;
+    advanceTo(targetUs);
+  }
+  pumpEvents();
+}
+
+time_t wallTime() {
+  return (time_t)(wallUs() / 1000000);
+}
+
+int64_t wallUs() {
+  return nowUs + wallOffsetUs;
+}
+
+bool ntpRequest(const char*, NtpDone done) {
+  if (ntpDueUs >= 0) return false;
+  ntpPendingOk = ntpReachable && wifiStaConnected();
+  ntpPendingDone = done;
+  ntpDueUs = nowUs + (int64_t)(ntpPendingOk ? ntpDelayMs : NTP_TIMEOUT_MS) * 1000;
+  return true;
+}
+
+// ---------- SYSTEM ----------
+uint32_t hwRandom() {
+  return 0x5EED;
+}
+
+void restart() {
+  Serial.println("[native] restart requested");
+}
+
+void* psramAlloc(size_t bytes) {
+  return calloc(1, bytes);   // the host has plenty; stands in for PSRAM
+}
+
+// No fixed heap on the host: an 8 MB PSRAM part and a 320 KB heap, untouched.
+MemStats memStats() {
+  return { 320 * 1024, 320 * 1024, 320 * 1024, 1, 0, 8 * 1024 * 1024, 8 * 1024 * 1024 };
+}
+
+AllocCounts allocCounts() {
+  return allocs;
+}
+
+// ---------- POWER ----------
+PowerInfo powerBegin(uint16_t maxMhz, uint16_t minMhz, bool lightSleep) {
+  return { true, lightSleep, maxMhz, minMhz };
+}
+
+void powerHold(bool on) {
+  if (on == (powerHeldSinceUs >= 0)) return;
+  if (on) {
+    powerHeldSinceUs = nowUs;
+  } else {
+    powerHeldTotalUs += nowUs - powerHeldSinceUs;
+    powerHeldSinceUs = -1;
+  }
+}
+
+void cpuMeterBegin() {
+  cpuMeterOn = true;
+}
+
+// The virtual clock only moves in waits, so the only busy time is spinning.
+int64_t cpuActiveUs() {
+  return spinUs / CPU_CORES;
+}
+
+// ---------- QUEUE / SHARED STATE ----------
+// Requests are issued between loop() calls on the same thread, so a queue
+// is a plain FIFO and the state lock has nothing to exclude.
+Queue queueCreate(size_t itemSize, size_t depth) {
+  HalHeap heap;
+  return new NativeQueue{ itemSize, depth, {} };
+}
+
+bool queueSend(Queue q, const void* item) {
+  HalHeap heap;
+  NativeQueue* nq = (NativeQueue*)q;
+  if (nq->items.size() >= nq->depth) return false;
+  const uint8_t* p = (const uint8_t*)item;
+  nq->items.emplace_back(p, p + nq->itemSize);
+  return true;
+}
+
+bool queueReceive(Queue q, void* item, uint32_t timeoutMs) {
+  HalHeap heap;
+  NativeQueue* nq = (NativeQueue*)q;
+  int64_t endUs = nowUs + (int64_t)timeoutMs * 1000;
+  for (;;) {
+    pumpEvents();
+    if (!nq->items.empty()) break;
+    if (nowUs >= endUs) return false;
+    nowUs = nextEventUs(endUs);
+  }
+  memcpy(item, nq->items.front().data(), nq->itemSize);
+  nq->items.pop_front();
+  return true;
+}
+
+void stateLock() {}
+void stateUnlock() {}
+
+// ---------- WORKER ----------
+// No threads on the host: a kicked job runs to completion on the virtual
+// clock before workerKick() returns.
+void workerStart(WorkerFn fn, const char*, uint32_t, uint8_t, int) {
+  workerFn = fn;
+}
+
+void workerKick() {
+  AllocAs engine(ALLOC_ENGINE);
+  if (workerFn) workerFn();
+  workerDone = true;
+}
+
+bool workerWait(uint32_t timeoutMs) {
+  if (workerDone) {
+    workerDone = false;
+    return true;
+  }
+  sleepMs(timeoutMs);
+  return false;
+}
+
+// ---------- RADIO (Si5351) ----------
+void radioInit() {
+  memset(regs, 0, sizeof(regs));
+  for (bool& e : clkEnabled) e = false;
+}
+
+void radioEnable(RadioClk clk, bool on) {
+  HalHeap heap;
+  if (on && !clkEnabled[clk]) {
+    clkKeyed[clk]++;
+    txs.push_back({ clk, nowUs, -1, native::trueUs(), native::radioFreqHz(clk) });
+  }
+  if (!on && clkEnabled[clk]) {
+    for (auto t = txs.rbegin(); t != txs.rend(); ++t) {
+      if (t->clk == clk) {
+        t->offUs = nowUs;
+        break;
+      }
+    }
+  }
+  clkEnabled[clk] = on;
+  recordWrite(3, 1);   // output enable control
+}
+
+void radioStop(RadioClk clk) {
+  memset(&regs[RADIO_MS_REG[clk]], 0, RADIO_MS_BYTES);
+  recordWrite(RADIO_MS_REG[clk], RADIO_MS_BYTES);
+}
+
+void radioLoadMs(RadioClk clk, const uint8_t img[RADIO_MS_BYTES]) {
+  recordWrite(26, 8);  // PLLA parameters
+  memcpy(&regs[RADIO_MS_REG[clk]], img, RADIO_MS_BYTES);
+  recordWrite(RADIO_MS_REG[clk], RADIO_MS_BYTES);
+}
+
+uint8_t radioWrite(uint8_t reg, const uint8_t* data, uint8_t n) {
+  if (radioFailures) {
+    radioFailures--;
+    return 0;
+  }
+  memcpy(&regs[reg], data, n);
+  recordWrite(reg, n);
+  return n + 1;
+}
+
+// ---------- LED ----------
+void ledInit() {
+  led = { 0, 0, 0 };
+}
+
+void ledStart(LedPattern pattern, uint32_t periodMs) {
+  ledPattern = pattern;
+  ledPeriodMs = periodMs;
+  ledDueUs = nowUs;
+}
+
+// ---------- WIFI ----------
+// The fake AP answers after staConnectDelayMs (or the cached delay when
+// steered by BSSID + channel); an unreachable or mis-steered one fails.
+void wifiStaConnect(const char*, const WifiStaConfig& cfg, WifiLinkFn onLink) {
+  HalHeap heap;
+  staLinkFn = onLink;
+  staUp = false;
+  const bool steered = cfg.bssid && cfg.channel;
+  const bool rightAp = !steered || (!memcmp(cfg.bssid, STA_BSSID, 6) && cfg.channel == STA_CHANNEL);
+  staPendingLink = {};
+  staPendingLink.up = staReachable && rightAp;
+  if (staPendingLink.up) {
+    memcpy(staPendingLink.bssid, STA_BSSID, 6);
+    staPendingLink.channel = STA_CHANNEL;
+  } else {
+    staPendingLink.reason = REASON_NO_AP_FOUND;
+  }
+  staEventUs = nowUs + (int64_t)(steered ? staCachedConnectDelayMs : staConnectDelayMs) * 1000;
+  if (cfg.ip) {
+    snprintf(staIpText, sizeof(staIpText), "%u.%u.%u.%u", (unsigned)(cfg.ip >> 24),
+             (unsigned)(cfg.ip >> 16) & 255, (unsigned)(cfg.ip >> 8) & 255, (unsigned)cfg.ip & 255);
+  } else {
+    strcpy(staIpText, "192.168.1.50");
+  }
+}
+
+bool wifiStaConnected() {
+  return staUp;
+}
+
+const char* wifiStaIp() {
+  return staUp ? staIpText : "0.0.0.0";
+}
+
+bool wifiStartAp(const char*, const char*) {
+  apUp = true;
+  return true;
+}
+
+const char* wifiApIp() {
+  return apUp ? "192.168.4.1" : "0.0.0.0";
+}
+
+// Completes at once, on the caller's thread.
+bool wifiScanStart(WifiScanDone done) {
+  done((int)scanResults.size());
+  return true;
+}
+
+const char* wifiScanSsid(int i) {
+  return scanResults[i].ssid.c_str();
+}
+
+int32_t wifiScanRssi(int i) {
+  return scanResults[i].rssi;
+}
+
+void wifiScanDelete() {}
+
+void dnsStart() {}
+
+bool mdnsBegin(const char*) {
+  return true;
+}
+
+// ---------- HTTP ----------
+void httpOn(const char* uri, HttpMethod method, HttpHandler handler) {
+  HalHeap heap;
+  routes.push_back({ uri, method, handler });
+}
+
+void httpOnNotFound(HttpHandler handler) {
+  notFound = handler;
+}
+
+void httpCollectHeaders(const char**, size_t) {}
+void httpBegin(uint16_t) {}
+
+int64_t httpFirstResponseUs() {
+  return firstResponseUs;
+}
+
+// std::map lookups by const char* build a key string: done under HalHeap,
+// as the device looks up in place.
+bool httpHasArg(const char* name) {
+  HalHeap heap;
+  return reqArgs && reqArgs->count(name);
+}
+
+const char* httpArg(const char* name) {
+  HalHeap heap;
+  if (!reqArgs) return "";
+  auto it = reqArgs->find(name);
+  return it == reqArgs->end() ? "" : it->second.c_str();
+}
+
+const char* httpHeader(const char* name) {
+  HalHeap heap;
+  if (!reqHeaders) return "";
+  auto it = reqHeaders->find(name);
+  return it == reqHeaders->end() ? "" : it->second.c_str();
+}
+
+const char* httpBody() {
+  return reqBody;
+}
+
+void httpSendHeader(const char* name, const char* value) {
+  HalHeap heap;
+  if (resp) resp->headers.push_back({ name, value });
+}
+
+void httpSend(int code, const char* type, const char* body) {
+  HalHeap heap;
+  if (!resp) return;
+  resp->code = code;
+  resp->type = type ? type : "";
+  resp->body = body ? body : "";
+}
+
+void httpSendStatic(int code, const char* type, const uint8_t* data, size_t len) {
+  HalHeap heap;
+  if (!resp) return;
+  resp->code = code;
+  resp->type = type ? type : "";
+  resp->body.assign((const char*)data, len);
+}
+
+// Like the device: chunks land in a fixed slot (one is enough, requests
+// run one at a time) and only a finished body is handed to the response;
+// a body over HTTP_CHUNKED_MAX becomes a 500.
+static char slot[HTTP_CHUNKED_MAX];
+static size_t slotLen = 0;
+static bool slotOverflow = false;
+static bool slotOpen = false;
+
+void httpBeginChunked(int code, const char* type) {
+  HalHeap heap;
+  if (!resp) return;
+  resp->code = code;
+  resp->type = type ? type : "";
+  resp->body.clear();
+  resp->chunks = 0;
+  slotLen = 0;
+  slotOverflow = false;
+  slotOpen = true;
+}
+
+void httpSendChunk(const char* data, size_t len) {
+  if (!resp || !slotOpen || slotOverflow) return;
+  resp->chunks++;
+  if (slotLen + len > HTTP_CHUNKED_MAX) {
+    slotOverflow = true;
+    return;
+  }
+  memcpy(slot + slotLen, data, len);
+  slotLen += len;
+}
+
+void httpEndChunked() {
+  if (!resp || !slotOpen) return;
+  slotOpen = false;
+  if (slotOverflow) {
+    httpSend(500, "text/plain", "Response too large");
+    return;
+  }
+  HalHeap heap;
+  resp->body.assign(slot, slotLen);
+}
+
+void eventsBegin(const char*) {
+  eventRing = (NativeQueue*)queueCreate(sizeof(EventMsg), EVENTS_RING);
+}
+
+uint8_t eventsClients() {
+  return eventClients;
+}
+
+// No HalHeap: this runs on the beacon, and any allocation is its own.
+void eventsSend(const char* event, const char* data, uint32_t id) {
+  static EventMsg m;
+  if (!eventRing || !eventClients) return;
+  m.id = id;
+  strlcpy(m.event, event, sizeof(m.event));
+  strlcpy(m.data, data, sizeof(m.data));
+  queueSend(eventRing, &m);   // full: lost, and the id gap fails the run
+}
+
+// ---------- FILES (LittleFS) ----------
+bool fsBegin() {
+  return true;
+}
+
+bool fsAppend(const char* path, const void* data, size_t len) {
+  charge(fileOps);
+  HalHeap heap;
+  files[path].append((const char*)data, len);
+  return true;
+}
+
+size_t fsRead(const char* path, size_t offset, void* buf, size_t len) {
+  charge(fileOps);
+  HalHeap heap;
+  auto it = files.find(path);
+  if (it == files.end() || offset >= it->second.size()) return 0;
+  size_t n = std::min(len, it->second.size() - offset);
+  memcpy(buf, it->second.data() + offset, n);
+  return n;
+}
+
+size_t fsSize(const char* path) {
+  charge(fileOps);
+  HalHeap heap;
+  auto it = files.find(path);
+  return it == files.end() ? 0 : it->second.size();
+}
+
+bool fsRename(const char* from, const char* to) {
+  charge(fileOps);
+  HalHeap heap;
+  auto it = files.find(from);
+  if (it == files.end()) return false;
+  files[to] = std::move(it->second);
+  files.erase(from);
+  return true;
+}
+
+void fsRemove(const char* path) {
+  charge(fileOps);
+  HalHeap heap;
+  files.erase(path);
+}
+
+// ---------- KEY/VALUE STORAGE (NVS) ----------
+bool kvBegin(const char* ns, bool) {
+  charge(nvsOpens);
+  HalHeap heap;
+  kvOpen = &kvStore[ns];
+  return true;
+}
+
+void kvEnd() {
+  kvOpen = nullptr;
+}
+
+bool kvHas(const char* key) {
+  HalHeap heap;
+  return kvOpen && kvOpen->count(key);
+}
+
+String kvGetString(const char* key, const char* def) {
+  HalHeap heap;
+  return kvHas(key) ? String((*kvOpen)[key].c_str()) : String(def);
+}
+
+void kvPutString(const char* key, const String& value) {
+  HalHeap heap;
+  if (kvOpen) (*kvOpen)[key] = value.c_str();
+}
+
+uint8_t kvGetU8(const char* key, uint8_t def) {
+  HalHeap heap;
+  return kvHas(key) ? (uint8_t)strtoul((*kvOpen)[key].c_str(), nullptr, 10) : def;
+}
+
+void kvPutU8(const char* key, uint8_t value) {
+  HalHeap heap;
+  if (kvOpen) (*kvOpen)[key] = std::to_string(value);
+}
+
+uint16_t kvGetU16(const char* key, uint16_t def) {
+  HalHeap heap;
+  return kvHas(key) ? (uint16_t)strtoul((*kvOpen)[key].c_str(), nullptr, 10) : def;
+}
+
+void kvPutU16(const char* key, uint16_t value) {
+  HalHeap heap;
+  if (kvOpen) (*kvOpen)[key] = std::to_string(value);
+}
+
+bool kvGetBool(const char* key, bool def) {
+  HalHeap heap;
+  return kvHas(key) ? (*kvOpen)[key] == "1" : def;
+}
+
+void kvPutBool(const char* key, bool value) {
+  HalHeap heap;
+  if (kvOpen) (*kvOpen)[key] = value ? "1" : "0";
+}
+
+double kvGetDouble(const char* key, double def) {
+  HalHeap heap;
+  return kvHas(key) ? strtod((*kvOpen)[key].c_str(), nullptr) : def;
+}
+
+void kvPutDouble(const char* key, double value) {
+  HalHeap heap;
+  if (!kvOpen) return;
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.17g", value);
+  (*kvOpen)[key] = buf;
+}
+
+size_t kvGetBytes(const char* key, void* buf, size_t len) {
+  HalHeap heap;
+  if (!kvHas(key)) return 0;
+  const std::string& v = (*kvOpen)[key];
+  if (v.size() > len) return 0;
+  memcpy(buf, v.data(), v.size());
+  return v.size();
+}
+
+void kvPutBytes(const char* key, const void* data, size_t len) {
+  HalHeap heap;
+  if (!kvOpen) return;
+  (*kvOpen)[key].assign((const char*)data, len);
+  kvBlobWrites++;
+}
+
+void kvRemove(const char* key) {
+  HalHeap heap;
+  if (kvOpen) kvOpen->erase(key);
+}
+
+} // namespace hal
+
+#endif // !ARDUINO
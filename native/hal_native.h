@@ -0,0 +1,100 @@
+// Controls for the native (mock) HAL backend.
+//
+// The host entry point uses these to seed NVS, script the network and
+// inspect what the beacon did to the (fake) Si5351 and web server.
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../hal.h"
+
+namespace native {
+
+// ---------- VIRTUAL CLOCK ----------
+// hal::sleepMs()/waitUntilUs() jump the clock instead of sleeping.
+// Wall time is invalid (small) until the fake NTP has synced.
+void setNtpReachable(bool ok);
+// Every tick sleep inside a precise wait wakes a random 0..us late, as if
+// preempted before it could spin (wake-up jitter).
+void setWakeLatencyUs(uint32_t us);
+// The local clock jumps by deltaUs (RTC glitch, bad manual set); true time
+// does not, so the next NTP sync pulls it back.
+void stepWall(int64_t deltaUs);
+// Reference UTC in us (what the fake NTP serves), -1 before the first sync.
+int64_t trueUs();
+
+// ---------- SCRIPT ----------
+// Actions run once the virtual clock reaches monoUs, from whatever wait
+// moves it there; waits never jump past a pending action.
+void at(int64_t monoUs, std::function<void()> action);
+
+// ---------- NETWORK SCRIPT ----------
+void setStaReachable(bool ok);           // fake AP accepts association
+void dropSta();                          // the AP goes away (link-down event)
+void addScanResult(const char* ssid, int32_t rssi);
+
+// ---------- FAKE SI5351 ----------
+struct RadioWrite {
+  int64_t atUs;
+  uint8_t reg;
+  uint8_t len;
+};
+const std::vector<RadioWrite>& radioWrites();
+bool radioEnabled(hal::RadioClk clk);
+uint32_t radioKeyCount(hal::RadioClk clk); // off -> on transitions
+double radioFreqHz(hal::RadioClk clk);   // decoded from MSx registers
+uint32_t radioBusBytes();
+void failRadioWrites(uint32_t n);        // the next n hal::radioWrite() calls NAK
+// Every keying of an output, in order.
+struct TxRecord {
+  hal::RadioClk clk;
+  int64_t onUs;                          // monotonic
+  int64_t offUs;                         // -1 while still keyed
+  int64_t onTrueUs;                      // reference UTC, see trueUs()
+  double freqHz;                         // tone loaded at key-on
+};
+const std::vector<TxRecord>& txLog();
+
+// ---------- POWER ----------
+int64_t powerHeldUs();                   // total time under hal::powerHold()
+
+// ---------- LED ----------
+hal::Rgb ledColor();                     // as last rendered by the LED task
+
+// ---------- NVS ----------
+void kvSeed(const char* ns, const char* key, const std::string& value);
+uint32_t kvBlobWriteCount();             // hal::kvPutBytes() calls
+
+// ---------- FLASH ----------
+// LittleFS calls and kvBegin() sessions by calling task, counted like
+// hal::allocCounts(): they allocate on the device.
+hal::AllocCounts flashFileOps();
+hal::AllocCounts flashNvsOpens();
+
+// ---------- HTTP ----------
+struct HttpResponse {
+  int code = 0;
+  std::string type;
+  std::string body;
+  std::vector<std::pair<std::string, std::string>> headers;
+  uint32_t chunks = 0;                   // body pieces sent by httpSendChunk
+};
+HttpResponse httpRequest(const char* method, const char* uri,
+                         const std::map<std::string, std::string>& args = {},
+                         const std::map<std::string, std::string>& headers = {},
+                         const char* body = nullptr);
+
+// ---------- PUSH (SSE) ----------
+struct PushEvent {
+  int64_t atUs;
+  std::string event;
+  std::string data;
+  uint32_t id;
+};
+void setEventClients(uint8_t n);         // fake open /events streams
+const std::vector<PushEvent>& events();  // everything sent while any was open
+
+} // namespace native
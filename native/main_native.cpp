@@ -0,0 +1,474 @@
+// Host entry point for [env:native].
+//
+// Boots the beacon from main.cpp against the mock HAL and runs loop() on
+// the virtual clock, then prints what went out over the fake Si5351 and
+// the /status document. With a seed, a random but repeatable fault script
+// (WiFi drops, NTP outages, local clock steps) runs alongside, and every
+// frame is checked against true UTC and the slot plan. Every tick sleep in
+// a precise wait wakes up to WAKE_LATENCY_US late, less than the spin
+// window, so each tone write must still land on its ideal symbol edge. A burst of web traffic runs every
+// virtual minute or so; once warmed up, neither it nor the beacon may
+// allocate. Sampled LED, keying and tone state, the full-clock hold,
+// injected Si5351 NAKs, push events and settings-blob writes are checked
+// against what the frames and saves should have produced.
+//
+//   .pio/build/native/program [hours] [-q] [-s seed]
+#ifndef ARDUINO
+
+#include "hal_native.h"
+#include "../json_reader.h"
+
+#include <random>
+
+void setup();
+void loop();
+time_t computeNextTxEpoch(time_t now, uint8_t* band);
+
+// Mirrors main.cpp: key-up leads symbol 0, which starts 1 s into the slot.
+static const int64_t KEY_LEAD_US = 5000;
+static const int64_t SLOT_US = 120000000;
+static const int64_t START_OFFSET_US = 1000000;
+static const int64_t FRAME_US = 110592000;     // 162 symbols of 8192/12000 s
+static const int64_t START_TOLERANCE_US = 1000;
+static const int64_t LENGTH_TOLERANCE_US = 50000;
+// Preemption injected after every tick sleep of a precise wait, before its
+// spin. It fits in hal::WAIT_SPIN_US less the 1 ms tick, so the spin must
+// absorb it and every edge land within EDGE_TOLERANCE_US; at 1.5 ms or more
+// late edges appear and the run fails.
+static const uint32_t WAKE_LATENCY_US = 1400;
+static const int64_t TICK_US = 1000;
+static const int64_t EDGE_TOLERANCE_US = 1;
+static const int64_t TX_PREP_LEAD_US = 250000;  // full clock from here to the end of the frame
+static const double TONE_SPACING_HZ = 12000.0 / 8192;
+
+// One fault every 3-9 virtual hours, each undone after a while.
+static uint32_t scheduleFaults(uint32_t seed, int64_t endUs) {
+  std::mt19937 rng(seed);
+  auto pick = [&](int64_t lo, int64_t hi) { return lo + (int64_t)(rng() % (uint64_t)(hi - lo)); };
+  uint32_t n = 0;
+  for (int64_t t = pick(180, 540) * 60000000LL; t < endUs; t += pick(180, 540) * 60000000LL, n++) {
+    switch (rng() % 3) {
+    case 0: {
+      int64_t upUs = t + pick(5, 40) * 60000000LL;
+      Serial.printf("[script] %7.2f h  WiFi down until %.2f h\n", t / 3600e6, upUs / 3600e6);
+      native::at(t, [] { native::setStaReachable(false); native::dropSta(); });
+      native::at(upUs, [] { native::setStaReachable(true); });
+      break;
+    }
+    case 1: {
+      int64_t upUs = t + pick(1, 6) * 3600000000LL;
+      Serial.printf("[script] %7.2f h  NTP unreachable until %.2f h\n", t / 3600e6, upUs / 3600e6);
+      native::at(t, [] { native::setNtpReachable(false); });
+      native::at(upUs, [] { native::setNtpReachable(true); });
+      break;
+    }
+    default: {
+      int64_t stepUs = pick(50, 5000) * 1000 * (rng() % 2 ? 1 : -1);
+      Serial.printf("[script] %7.2f h  local clock steps %+lld ms\n", t / 3600e6, (long long)(stepUs / 1000));
+      native::at(t, [stepUs] { native::stepWall(stepUs); });
+      break;
+    }
+    }
+  }
+  return n;
+}
+
+// Worst symbol-edge lateness over every frame listed in /timing.
+static long worstEdgeP99Us = 0, worstEdgeMaxUs = 0;
+static uint32_t edgeFrames = 0;
+
+static bool noteEdges(const std::string& timing) {
+  JsonReader r(timing.data(), timing.size());
+  char key[16];
+  if (!r.beginObject()) return false;
+  while (r.nextKey(key, sizeof(key))) {
+    if (strcmp(key, "frames") != 0) { r.skip(); continue; }
+    if (!r.beginArray()) return false;
+    while (r.nextItem() && r.beginObject()) {
+      edgeFrames++;
+      while (r.nextKey(key, sizeof(key))) {
+        if (strcmp(key, "edge_us") != 0) { r.skip(); continue; }
+        if (!r.beginObject()) return false;
+        while (r.nextKey(key, sizeof(key))) {
+          long us;
+          if (!r.integer(&us, INT32_MIN, INT32_MAX)) return false;
+          if (!strcmp(key, "p99")) worstEdgeP99Us = max(worstEdgeP99Us, us);
+          if (!strcmp(key, "max")) worstEdgeMaxUs = max(worstEdgeMaxUs, us);
+        }
+      }
+    }
+  }
+  return r.ok() && r.done();
+}
+
+static const int64_t ALLOC_WARMUP_US = 3600000000LL;
+static const int64_t TRAFFIC_EVERY_US = 60000000;
+
+// What a dashboard, a scraper and a provisioning script do between two
+// frames. Saves resend the values already set, so the plan doesn't change.
+// Returns the number of requests not answered with 2xx.
+static uint32_t webTraffic() {
+  static const std::map<std::string, std::string> none;
+  static const std::map<std::string, std::string> schedule = { { "n", "20" } };
+  static const std::map<std::string, std::string> history = { { "n", "5" }, { "format", "bin" } };
+  static const std::map<std::string, std::string> save = { { "mode", "single" }, { "txpct", "100" } };
+  static const std::map<std::string, std::string> wspr = {
+    { "call", "M0DQW" }, { "loc", "IO91" }, { "pwr", "10" }, { "band", "3" }, { "txen", "1" },
+    { "cal_3", "600" }, { "ocal_0", "0" },   // the 40m default, no output trim
+  };
+  static const char* const GETS[] = { "/", "/status", "/bands", "/metrics", "/scan" };
+  uint32_t bad = 0;
+  auto check = [&bad](const native::HttpResponse& r) { bad += r.code < 200 || r.code > 299; };
+  for (const char* uri : GETS) check(native::httpRequest("GET", uri, none));
+  native::HttpResponse timing = native::httpRequest("GET", "/timing", none);
+  check(timing);
+  bad += !noteEdges(timing.body);
+  check(native::httpRequest("GET", "/schedule", schedule));
+  check(native::httpRequest("GET", "/history", history));
+  check(native::httpRequest("POST", "/save_schedule", save));
+  check(native::httpRequest("POST", "/save_wspr", wspr));
+  native::HttpResponse config = native::httpRequest("GET", "/config", none);
+  check(config);
+  check(native::httpRequest("PUT", "/config", none, none, config.body.c_str()));
+  return bad;
+}
+
+static uint32_t allocSum(const hal::AllocCounts& a) {
+  return a.beacon + a.engine + a.other;
+}
+
+// Checks CLK0 frames against true UTC and the plan. Returns the number of
+// failures: overlapping or cut-short frames, and with no faults scripted
+// also late frames and missed slots.
+static uint32_t checkFrames(bool faults) {
+  uint32_t frames = 0, misaligned = 0, badLength = 0, overlaps = 0, missed = 0;
+  int64_t worstErrUs = 0, prevOffUs = -1;
+  std::vector<time_t> slots;
+  for (const native::TxRecord& t : native::txLog()) {
+    if (t.clk != hal::CLK0) continue;
+    frames++;
+    int64_t startUs = t.onTrueUs + KEY_LEAD_US;
+    int64_t slotUs = (startUs - START_OFFSET_US + SLOT_US / 2) / SLOT_US * SLOT_US;
+    int64_t errUs = startUs - START_OFFSET_US - slotUs;
+    if (llabs(errUs) > llabs(worstErrUs)) worstErrUs = errUs;
+    if (llabs(errUs) > START_TOLERANCE_US) misaligned++;
+    if (t.offUs >= 0 && llabs(t.offUs - t.onUs - KEY_LEAD_US - FRAME_US) > LENGTH_TOLERANCE_US) badLength++;
+    if (prevOffUs >= 0 && t.onUs < prevOffUs) overlaps++;
+    prevOffUs = t.offUs;
+    slots.push_back((time_t)(slotUs / 1000000));
+  }
+
+  // Walk the plan from the first frame to the end of the run: every planned
+  // slot should have exactly one frame.
+  if (!slots.empty()) {
+    time_t endSlot = (time_t)(native::trueUs() / 1000000) - (time_t)(FRAME_US / 1000000) - 2;
+    size_t k = 0;
+    for (time_t s = slots[0]; s && s <= endSlot; s = computeNextTxEpoch(s, nullptr)) {
+      while (k < slots.size() && slots[k] < s) k++;
+      if (k < slots.size() && slots[k] == s) k++;
+      else missed++;
+    }
+  }
+
+  Serial.printf("[check] %u frame(s): worst start error %+lld us, %u outside +-%lld us\n",
+                frames, (long long)worstErrUs, misaligned, (long long)START_TOLERANCE_US);
+  Serial.printf("[check] %u planned slot(s) missed (dead time %.1f min), %u cut short, %u overlapping\n",
+                missed, missed * FRAME_US / 60e6, badLength, overlaps);
+  return badLength + overlaps + (faults ? 0 : misaligned + missed);
+}
+
+// Times every Si5351 write inside a frame against the ideal symbol edges
+// of its UTC slot, independently of what the engine reports about itself.
+// Symbol 0 is preloaded before key-up, so edges 1..161 are checked. A
+// drifting edge schedule shows here even if each wait looks on time. With
+// faults the clock mapping itself may be off, so only report.
+static uint32_t checkEdges(bool faults) {
+  const std::vector<native::RadioWrite>& writes = native::radioWrites();
+  const double symbolUs = FRAME_US / 162.0;
+  int64_t earliestUs = 0, latestUs = 0;
+  uint32_t edges = 0;
+  for (const native::TxRecord& t : native::txLog()) {
+    if (t.clk != hal::CLK0 || t.offUs < 0) continue;
+    int64_t slotUs = (t.onTrueUs + KEY_LEAD_US - START_OFFSET_US + SLOT_US / 2) / SLOT_US * SLOT_US;
+    int64_t zeroUs = t.onUs + (slotUs + START_OFFSET_US - t.onTrueUs);   // ideal symbol 0, monotonic
+    auto it = std::lower_bound(writes.begin(), writes.end(), t.onUs,
+                               [](const native::RadioWrite& w, int64_t us) { return w.atUs < us; });
+    for (; it != writes.end() && it->atUs < t.offUs; ++it) {
+      int64_t k = llround((it->atUs - zeroUs) / symbolUs);
+      if (k < 1 || k > 161) continue;
+      int64_t errUs = it->atUs - zeroUs - llround(k * symbolUs);
+      earliestUs = edges ? min(earliestUs, errUs) : errUs;
+      latestUs = edges ? max(latestUs, errUs) : errUs;
+      edges++;
+    }
+  }
+  Serial.printf("[check] %u tone write(s) vs UTC symbol edges: %+lld..%+lld us\n",
+                edges, (long long)earliestUs, (long long)latestUs);
+  if (faults) return 0;
+  return !edges || earliestUs < -EDGE_TOLERANCE_US || latestUs > EDGE_TOLERANCE_US;
+}
+
+// What the LED, the outputs and CLK0's tone look like at moments that fall
+// nowhere in particular, sampled from a script action that re-arms itself.
+struct StateSample {
+  int64_t atUs;
+  bool keyed;
+  hal::Rgb led;
+  double freqHz;
+};
+static std::vector<StateSample> samples;
+static const int64_t SAMPLE_EVERY_US = 7300000;
+static const int64_t SAMPLE_GUARD_US = 100000;   // two LED periods either side of a key change
+
+static void sampleState() {
+  samples.push_back({ hal::monoUs(), native::radioEnabled(hal::CLK0), native::ledColor(),
+                      native::radioFreqHz(hal::CLK0) });
+  native::at(hal::monoUs() + SAMPLE_EVERY_US, sampleState);
+}
+
+// Well inside a frame: RF on, the LED in its TX colour (red, a green tint
+// for progress) and CLK0 on one of the four tones around the key-up one.
+// Well outside: RF off and no TX colour.
+static uint32_t checkSamples() {
+  const std::vector<native::TxRecord>& txs = native::txLog();
+  uint32_t inside = 0, outside = 0, bad = 0;
+  for (const StateSample& s : samples) {
+    const native::TxRecord* frame = nullptr;
+    bool near = false;
+    for (const native::TxRecord& t : txs) {
+      if (t.clk != hal::CLK0) continue;
+      int64_t offUs = t.offUs < 0 ? INT64_MAX : t.offUs;
+      if (s.atUs >= t.onUs + SAMPLE_GUARD_US && s.atUs < offUs - SAMPLE_GUARD_US) frame = &t;
+      else if (s.atUs >= t.onUs - SAMPLE_GUARD_US && s.atUs < offUs + SAMPLE_GUARD_US) near = true;
+    }
+    bool txColour = s.led.r == 20 && s.led.b == 0;
+    if (frame) {
+      double tones = (s.freqHz - frame->freqHz) / TONE_SPACING_HZ;
+      bool onTone = fabs(tones - lround(tones)) < 0.05 && labs(lround(tones)) <= 3;
+      bad += !s.keyed || !txColour || !onTone;
+      inside++;
+    } else if (!near) {
+      bad += s.keyed || txColour;
+      outside++;
+    }
+  }
+  Serial.printf("[check] %u state sample(s) in frames, %u between: %u with the wrong LED, keying or tone\n",
+                inside, outside, bad);
+  return bad + !inside + !outside;
+}
+
+// Full clock is held from TX_PREP_LEAD_US before each frame to its end and
+// at no other time.
+static uint32_t checkPower() {
+  int64_t keyedUs = 0;
+  uint32_t frames = 0;
+  for (const native::TxRecord& t : native::txLog()) {
+    if (t.clk != hal::CLK0 || t.offUs < 0) continue;
+    keyedUs += t.offUs - t.onUs;
+    frames++;
+  }
+  int64_t extraUs = native::powerHeldUs() - keyedUs;
+  Serial.printf("[check] full clock held %.1f s beyond %u frame(s) keyed, at most %.1f s allowed\n",
+                extraUs / 1e6, frames, frames * TX_PREP_LEAD_US / 1e6);
+  uint32_t bad = extraUs < 0 || extraUs > frames * TX_PREP_LEAD_US;
+
+  // Busy time: every symbol edge spins on one of two cores, at most
+  // WAIT_SPIN_US and at least that less a tick and the injected preemption;
+  // besides them, at most one precise wait per slot. /status must report
+  // the same share.
+  int64_t activeUs = hal::cpuActiveUs();
+  int64_t edgeSpinUs = (int64_t)frames * 162 * hal::WAIT_SPIN_US / 2;
+  int64_t edgeSpinMinUs = (int64_t)frames * 162 * (hal::WAIT_SPIN_US - TICK_US - WAKE_LATENCY_US) / 2;
+  native::HttpResponse st = native::httpRequest("GET", "/status");
+  const char* pct = strstr(st.body.c_str(), "\"cpu_active_pct\":");
+  double reported = pct ? atof(pct + strlen("\"cpu_active_pct\":")) : -1;
+  double expected = activeUs * 100.0 / hal::monoUs();
+  Serial.printf("[check] CPU busy %.1f s (%.2f%%, /status %.1f%%), edge spins alone %.1f..%.1f s\n",
+                activeUs / 1e6, expected, reported, edgeSpinMinUs / 1e6, edgeSpinUs / 1e6);
+  bad += activeUs < edgeSpinMinUs || activeUs > edgeSpinUs + hal::monoUs() / SLOT_US * hal::WAIT_SPIN_US;
+  bad += fabs(reported - expected) > 0.051;
+  return bad;
+}
+
+// Si5351 NAKs scripted into the run: each is counted once in /metrics and
+// the next tone rewrites what it lost (checkSamples/checkEdges see no harm).
+static const int64_t NAK_EVERY_US = 5 * 3600000000LL + 17000000;
+static const uint32_t NAK_WRITES = 2;
+
+static uint32_t checkI2cErrors(uint32_t injected) {
+  native::HttpResponse m = native::httpRequest("GET", "/metrics");
+  const char* line = strstr(m.body.c_str(), "\nwspr_i2c_errors_total ");
+  long counted = line ? atol(line + strlen("\nwspr_i2c_errors_total ")) : -1;
+  Serial.printf("[check] %u Si5351 write(s) NAKed, %ld counted in /metrics\n", injected, counted);
+  return counted != (long)injected;
+}
+
+// /events while a client is connected: every event a JSON object, ids
+// consecutive, and one final "tx" (on false, all symbols) per frame ended.
+static int64_t eventsFromUs = 0, eventsToUs = 0;
+
+static bool finalTx(const std::string& data) {
+  JsonReader r(data.data(), data.size());
+  char key[16];
+  bool on = true;
+  long sent = -1;
+  if (!r.beginObject()) return false;
+  while (r.nextKey(key, sizeof(key))) {
+    if (strcmp(key, "tx") != 0) { r.skip(); continue; }
+    if (!r.beginObject()) return false;
+    while (r.nextKey(key, sizeof(key))) {
+      if (!strcmp(key, "on")) r.boolean(&on);
+      else if (!strcmp(key, "sent")) r.integer(&sent, 0, 162);
+      else r.skip();
+    }
+  }
+  return r.ok() && !on && sent == 162;
+}
+
+static uint32_t checkEvents() {
+  const std::vector<native::PushEvent>& events = native::events();
+  uint32_t bad = 0, ended = 0, frames = 0;
+  for (size_t i = 0; i < events.size(); i++) {
+    const native::PushEvent& e = events[i];
+    JsonReader r(e.data.data(), e.data.size());
+    bad += e.data.empty() || e.data[0] != '{' || !r.skip() || !r.done();
+    if (i && e.id != events[i - 1].id + 1) bad++;
+    if (e.event == "tx" && finalTx(e.data)) ended++;
+  }
+  for (const native::TxRecord& t : native::txLog()) {
+    frames += t.clk == hal::CLK0 && t.offUs >= eventsFromUs && t.offUs < eventsToUs;
+  }
+  Serial.printf("[check] %zu push event(s) in %.1f h: %u malformed or out of order, %u frame end(s) for %u frame(s)\n",
+                events.size(), (eventsToUs - eventsFromUs) / 3600e6, bad, ended, frames);
+  return bad + (ended != frames) + events.empty();
+}
+
+// Settings are written to NVS once per change and never for a save that
+// changes nothing; the traffic bursts already resend unchanged values.
+static uint32_t applySave(const char* method, const char* uri,
+                          const std::map<std::string, std::string>& args, const char* body) {
+  uint32_t before = native::kvBlobWriteCount();
+  native::httpRequest(method, uri, args, {}, body);
+  bool quiet = Serial.quiet;
+  Serial.quiet = true;
+  loop();   // applies the command and returns to re-plan
+  Serial.quiet = quiet;
+  return native::kvBlobWriteCount() - before;
+}
+
+static uint32_t checkSaves(uint32_t steadyWrites, bool faults) {
+  std::map<std::string, std::string> wspr = {
+    { "call", "M0DQW" }, { "loc", "IO91" }, { "pwr", "10" }, { "band", "3" }, { "txen", "1" },
+  };
+  uint32_t same = applySave("POST", "/save_wspr", wspr, nullptr);
+  wspr["pwr"] = "20";
+  uint32_t changed = applySave("POST", "/save_wspr", wspr, nullptr);
+  uint32_t configChanged = applySave("PUT", "/config", {}, "{\"pwr_dbm\":10}");
+  uint32_t configSame = applySave("PUT", "/config", {}, "{\"pwr_dbm\":10}");
+  Serial.printf("[check] settings blob writes: %u over the traffic after warm-up, "
+                "unchanged saves %u+%u, changed saves %u+%u\n",
+                steadyWrites, same, configSame, changed, configChanged);
+  return (faults ? 0 : steadyWrites) + same + configSame + (changed != 1) + (configChanged != 1);
+}
+
+int main(int argc, char** argv) {
+  double hours = 4.0;   // three past the allocation warm-up
+  uint32_t seed = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-q") == 0) Serial.quiet = true;
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else hours = atof(argv[i]);
+  }
+
+  native::kvSeed("esp32wspr", "ssid", "HostNet");
+  native::kvSeed("esp32wspr", "txen", "1");
+  native::setStaReachable(true);
+  native::addScanResult("HostNet", -48);
+  native::setWakeLatencyUs(WAKE_LATENCY_US);
+
+  const int64_t endUs = (int64_t)(hours * 3600e6);
+  bool quiet = Serial.quiet;
+  Serial.quiet = false;
+  uint32_t faults = seed ? scheduleFaults(seed, endUs) : 0;
+  Serial.quiet = quiet;
+
+  native::at(SAMPLE_EVERY_US, sampleState);
+  uint32_t naks = 0;
+  for (int64_t t = NAK_EVERY_US; t < endUs - 10 * 60000000LL; t += NAK_EVERY_US, naks += NAK_WRITES) {
+    native::at(t, [] { native::failRadioWrites(NAK_WRITES); });
+  }
+  // A browser on /events for up to two hours from mid-run.
+  eventsFromUs = endUs / 2;
+  eventsToUs = min(endUs, eventsFromUs + (int64_t)7200000000LL);
+  native::at(eventsFromUs, [] { native::setEventClients(1); });
+  native::at(eventsToUs, [] { native::setEventClients(0); });
+
+  setup();
+
+  hal::AllocCounts warm = {}, warmFiles = {}, warmNvs = {};
+  uint32_t warmBlobWrites = 0;
+  bool warmedUp = false;
+  int64_t trafficUs = 0;
+  uint32_t trafficFailures = 0;
+  while (hal::monoUs() < endUs) {
+    loop();
+    // A save re-plans and returns loop() at once: space the bursts out,
+    // and stop early enough for the last one to be applied.
+    if (hal::monoUs() - trafficUs >= TRAFFIC_EVERY_US && hal::monoUs() < endUs - TRAFFIC_EVERY_US) {
+      trafficFailures += webTraffic();
+      trafficUs = hal::monoUs();
+    }
+    if (!warmedUp && hal::monoUs() >= ALLOC_WARMUP_US) {
+      warm = hal::allocCounts();
+      warmFiles = native::flashFileOps();
+      warmNvs = native::flashNvsOpens();
+      warmBlobWrites = native::kvBlobWriteCount();
+      warmedUp = true;
+    }
+  }
+  hal::AllocCounts steady = hal::allocCounts();
+  uint32_t steadyBlobWrites = native::kvBlobWriteCount() - warmBlobWrites;
+  native::setEventClients(0);
+
+  native::HttpResponse st = native::httpRequest("GET", "/status");
+
+  Serial.quiet = false;
+  Serial.printf("\n[native] %.2f virtual hours, %u frame(s) keyed, %u scripted fault(s)\n",
+                hours, native::radioKeyCount(hal::CLK0), faults);
+  Serial.printf("[native] Si5351: %zu writes, %u bus bytes\n",
+                native::radioWrites().size(), native::radioBusBytes());
+  Serial.printf("[native] /status %d: %s\n", st.code, st.body.c_str());
+  uint32_t failures = checkFrames(faults > 0);
+  failures += checkEdges(faults > 0);
+  Serial.printf("[check] symbol edges, %u us wake-up jitter: worst p99 %+ld us, max %+ld us "
+                "over %u listed frame(s)\n", WAKE_LATENCY_US, worstEdgeP99Us, worstEdgeMaxUs, edgeFrames);
+  failures += !edgeFrames || worstEdgeMaxUs > EDGE_TOLERANCE_US;
+  Serial.printf("[check] web requests not answered 2xx: %u\n", trafficFailures);
+  failures += trafficFailures;
+  failures += checkSamples();
+  failures += checkPower();
+  failures += checkI2cErrors(naks);
+  failures += checkEvents();
+  if (warmedUp) {
+    Serial.printf("[check] heap allocations after warm-up: beacon %u, engine %u, web %u\n",
+                  steady.beacon - warm.beacon, steady.engine - warm.engine, steady.other - warm.other);
+    failures += allocSum(steady) - allocSum(warm);
+    // Exempt in hal.h, but counted so the exemption stays this size.
+    hal::AllocCounts files = native::flashFileOps(), nvs = native::flashNvsOpens();
+    Serial.printf("[check] flash opens after warm-up (allocate on the device, exempt): "
+                  "beacon %u file + %u NVS, web %u file + %u NVS, engine %u\n",
+                  files.beacon - warmFiles.beacon, nvs.beacon - warmNvs.beacon,
+                  files.other - warmFiles.other, nvs.other - warmNvs.other,
+                  files.engine - warmFiles.engine + nvs.engine - warmNvs.engine);
+    failures += files.engine - warmFiles.engine + nvs.engine - warmNvs.engine;
+  } else {
+    Serial.printf("[check] heap allocations: run ends inside the %.0f h warm-up, not checked\n",
+                  ALLOC_WARMUP_US / 3600e6);
+  }
+  // Last: these saves re-plan and key nothing more.
+  failures += checkSaves(warmedUp ? steadyBlobWrites : 0, faults > 0);
+  Serial.quiet = quiet;
+  return failures ? 1 : 0;
+}
+
+#endif // !ARDUINO
@@ -0,0 +1,65 @@
+"""Embed the web UI into the firmware as a gzipped flash array.
+
+Runs as a PlatformIO pre-build script (extra_scripts = pre:scripts/embed_web.py)
+or standalone (python3 scripts/embed_web.py). Reads web/index.html, applies a
+conservative minification, gzips it and writes web_ui.h next to main.cpp with
+the bytes, their length and a strong ETag derived from the content.
+"""
+import gzip
+import hashlib
+import os
+import re
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO/SCons)
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SRC = os.path.join(PROJECT_DIR, "web", "index.html")
+OUT = os.path.join(PROJECT_DIR, "web_ui.h")
+
+
+def minify(html):
+    # CSS comments only live inside <style>; JS only has whole-line // comments.
+    html = re.sub(r"/\*.*?\*/", "", html, flags=re.S)
+    lines = []
+    for line in html.splitlines():
+        line = line.strip()
+        if not line or line.startswith("//"):
+            continue
+        lines.append(line)
+    # Keep newlines: the script relies on automatic semicolon insertion.
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    with open(SRC, "r", encoding="utf-8") as f:
+        html = minify(f.read())
+    gz = gzip.compress(html.encode("utf-8"), compresslevel=9, mtime=0)
+    etag = hashlib.sha1(gz).hexdigest()[:16]
+
+    rows = []
+    for i in range(0, len(gz), 16):
+        rows.append("  " + ", ".join("0x%02x" % b for b in gz[i:i + 16]) + ",")
+
+    text = (
+        "// Generated by scripts/embed_web.py from web/index.html -- do not edit.\n"
+        "#pragma once\n\n"
+        "#include <Arduino.h>\n\n"
+        "static const char WEB_UI_ETAG[] = \"\\\"%s\\\"\";\n"
+        "static const size_t WEB_UI_GZ_LEN = %d;   // %d bytes before gzip\n"
+        "static const uint8_t WEB_UI_GZ[] PROGMEM = {\n%s\n};\n"
+    ) % (etag, len(gz), len(html), "\n".join(rows))
+
+    # Only touch the header when the UI changed, to keep incremental builds.
+    if os.path.exists(OUT):
+        with open(OUT, "r", encoding="utf-8") as f:
+            if f.read() == text:
+                return
+    with open(OUT, "w", encoding="utf-8") as f:
+        f.write(text)
+    print("embed_web: web_ui.h %d bytes gz (%d minified)" % (len(gz), len(html)))
+
+
+main()